@@ -140,11 +140,13 @@ void free_kpages(vaddr_t addr);
 */
 
 
+/*
+ * One page to invalidate. The target cpu does V(ts_done) when it has.
+ */
+struct semaphore;
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;
+	struct semaphore *ts_done;
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -82,7 +82,7 @@ syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
-	int whence;
+	int whence, fd;
 	off_t pos, retval_high;
 	int err;
 
@@ -114,6 +114,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 		case SYS_open:
 		err = sys_open((const_userptr_t) tf->tf_a0, tf->tf_a1, (mode_t)tf->tf_a2, &retval);
 		break;
@@ -130,6 +135,50 @@ syscall(struct trapframe *tf)
 		err = sys_write(tf->tf_a0, (const void *)tf->tf_a1, (size_t)tf->tf_a2, &retval);
 		break;
 
+		/*
+		 * The positional calls' 64-bit offset doesn't fit in a3,
+		 * so it goes on the stack at sp+16.
+		 */
+		case SYS_pread:
+		err = copyin((userptr_t)(tf->tf_sp+16), &pos, sizeof(off_t));
+		if (err) {
+			break;
+		}
+		err = sys_pread(tf->tf_a0, (void *)tf->tf_a1, (size_t)tf->tf_a2, pos, &retval);
+		break;
+
+		case SYS_pwrite:
+		err = copyin((userptr_t)(tf->tf_sp+16), &pos, sizeof(off_t));
+		if (err) {
+			break;
+		}
+		err = sys_pwrite(tf->tf_a0, (const void *)tf->tf_a1, (size_t)tf->tf_a2, pos, &retval);
+		break;
+
+		case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1, tf->tf_a2, &retval);
+		break;
+
+		case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1, tf->tf_a2, &retval);
+		break;
+
+		case SYS_preadv:
+		err = copyin((userptr_t)(tf->tf_sp+16), &pos, sizeof(off_t));
+		if (err) {
+			break;
+		}
+		err = sys_preadv(tf->tf_a0, (const_userptr_t)tf->tf_a1, tf->tf_a2, pos, &retval);
+		break;
+
+		case SYS_pwritev:
+		err = copyin((userptr_t)(tf->tf_sp+16), &pos, sizeof(off_t));
+		if (err) {
+			break;
+		}
+		err = sys_pwritev(tf->tf_a0, (const_userptr_t)tf->tf_a1, tf->tf_a2, pos, &retval);
+		break;
+
 		case SYS_chdir:
 		err = sys_chdir((const char *)tf->tf_a0);
 		break;
@@ -168,6 +217,27 @@ syscall(struct trapframe *tf)
         err = sbrk((intptr_t)tf->tf_a0, &retval);
         break;
 
+		case SYS_mmap:
+		/* fd is the fifth argument; the off_t after it is 8-aligned. */
+		err = copyin((userptr_t)(tf->tf_sp+16), &fd, sizeof(int));
+		if (err) {
+			break;
+		}
+		err = copyin((userptr_t)(tf->tf_sp+24), &pos, sizeof(off_t));
+		if (err) {
+			break;
+		}
+		err = sys_mmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1, tf->tf_a2, tf->tf_a3, fd, pos, &retval);
+		break;
+
+		case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1, &retval);
+		break;
+
+		case SYS_fsync:
+		err = sys_fsync(tf->tf_a0, &retval);
+		break;
+
       	//case SYS_waitpid:
       	//err = sys_waitpid(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2, &retval);
       	//break;
@@ -179,6 +249,11 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf,&retval);
 		break;
 
+		case SYS_spawn:
+		err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+				(const_userptr_t)tf->tf_a2, tf->tf_a3, &retval);
+		break;
+
       	case SYS__exit:
 		sys_exit(tf->tf_a0);
 		err = 0;
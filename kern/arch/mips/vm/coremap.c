@@ -4,221 +4,1527 @@
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
+#include <synch.h>
+#include <clock.h>
+#include <thread.h>
+#include <wchan.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <swap.h>
+#include <textcache.h>
 #include <machine/coremap.h>
 
+/*
+ * Physical page allocator.
+ *
+ * The coremap has one entry per physical frame and is indexed by
+ * frame number, so going from an address to its entry is just a
+ * shift. Free memory is managed as a binary buddy system: a free
+ * block of order k covers 2^k frames starting at a frame number that
+ * is a multiple of 2^k, and its head entry is on cm_freelist[k].
+ *
+ * Allocating npages takes the smallest free block of order
+ * >= ceil(log2(npages)), splitting larger blocks as needed, and hands
+ * the unused tail back to the free lists, so no memory is lost to
+ * rounding. Freeing merges with the buddy block for as long as the
+ * buddy is also free. Both are bounded by CM_NORDERS steps, and the
+ * common single-page case is a list pop or push.
+ *
+ * Frames below cm_firstframe hold the kernel image and the coremap
+ * itself; they are never put on a free list and are not counted in
+ * coremap_used_bytes().
+ */
+
+/* 2^(CM_NORDERS-1) pages is 512M, the most that kseg0 can map. */
+#define CM_NORDERS 18
+#define CM_NONE ((unsigned)-1)
+
+/* Free-frame watermarks for the pageout daemon; see vm_pageout. */
+#define CM_MINLOWATER 8
+#define CM_PAGEOUT_BATCH 16
+
+#define CM_FRAME(paddr) ((unsigned)((paddr) / PAGE_SIZE))
+#define CM_PADDR(frame) ((paddr_t)(frame) * PAGE_SIZE)
+
 static struct coremap_entry *coremap;
-struct spinlock *core_lock;
-unsigned sizeofmap;
+static struct spinlock core_lock = SPINLOCK_INITIALIZER;
+static unsigned sizeofmap;		/* number of frames of RAM */
+static unsigned cm_firstframe;		/* first frame we manage */
+static unsigned cm_freelist[CM_NORDERS];
+static unsigned cm_usedpages;
+static unsigned cm_clockhand;		/* next frame the clock looks at */
+static struct lock *cm_evict_lock;	/* one eviction at a time */
+static struct semaphore *cm_shootdown_sem;
+static struct wchan *cm_pinwchan;	/* waiting for a frame to unpin */
+static struct wchan *cm_pageout_wchan;	/* pageout daemon sleeps here */
+static unsigned cm_lowater;		/* wake the daemon below this */
+static unsigned cm_hiwater;		/* ...and it frees up to this */
+static unsigned cm_pageout_runs;
+static unsigned cm_pageout_cleaned;
+static unsigned cm_pageout_freed;
+static unsigned cm_fault_evictions;	/* evictions done in vm_fault */
 
+/*
+ * Smallest order whose block holds NPAGES.
+ */
+static
+unsigned
+cm_order_for(unsigned npages)
+{
+	unsigned order = 0;
 
-void initializeCoremap(void){
+	while ((1U << order) < npages) {
+		order++;
+	}
+	return order;
+}
+
+static
+void
+cm_list_add(unsigned frame, unsigned order)
+{
+	struct coremap_entry *e = &coremap[frame];
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+	KASSERT(!e->is_free_head);
+
+	e->is_free_head = 1;
+	e->order = order;
+	e->prev_free = CM_NONE;
+	e->next_free = cm_freelist[order];
+	if (cm_freelist[order] != CM_NONE) {
+		coremap[cm_freelist[order]].prev_free = frame;
+	}
+	cm_freelist[order] = frame;
+}
+
+static
+void
+cm_list_remove(unsigned frame)
+{
+	struct coremap_entry *e = &coremap[frame];
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+	KASSERT(e->is_free_head);
+
+	if (e->prev_free != CM_NONE) {
+		coremap[e->prev_free].next_free = e->next_free;
+	}
+	else {
+		cm_freelist[e->order] = e->next_free;
+	}
+	if (e->next_free != CM_NONE) {
+		coremap[e->next_free].prev_free = e->prev_free;
+	}
+	e->is_free_head = 0;
+	e->next_free = e->prev_free = CM_NONE;
+}
+
+/*
+ * Return the aligned block of 2^ORDER frames at FRAME to the free
+ * lists, coalescing with its buddy as far as possible.
+ */
+static
+void
+cm_free_block(unsigned frame, unsigned order)
+{
+	unsigned buddy;
+
+	while (order < CM_NORDERS - 1) {
+		buddy = frame ^ (1U << order);
+		if (buddy < cm_firstframe || buddy >= sizeofmap) {
+			break;
+		}
+		if (!coremap[buddy].is_free_head ||
+		    coremap[buddy].order != order) {
+			break;
+		}
+		cm_list_remove(buddy);
+		if (buddy < frame) {
+			frame = buddy;
+		}
+		order++;
+	}
+	cm_list_add(frame, order);
+}
+
+/*
+ * Free an arbitrary run of NPAGES frames starting at FRAME by
+ * breaking it into the largest aligned blocks that fit.
+ */
+static
+void
+cm_free_range(unsigned frame, unsigned npages)
+{
+	unsigned order;
+
+	while (npages > 0) {
+		order = 0;
+		while (order < CM_NORDERS - 1 &&
+		       (frame & ((2U << order) - 1)) == 0 &&
+		       (2U << order) <= npages) {
+			order++;
+		}
+		cm_free_block(frame, order);
+		frame += 1U << order;
+		npages -= 1U << order;
+	}
+}
+
+/*
+ * Take a run of NPAGES frames off the free lists. Returns the first
+ * frame, or CM_NONE if there is no free block big enough.
+ */
+static
+unsigned
+cm_alloc_frames(unsigned npages)
+{
+	unsigned want, order, frame, i;
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+	KASSERT(npages > 0);
+
+	want = cm_order_for(npages);
+	for (order = want; order < CM_NORDERS; order++) {
+		if (cm_freelist[order] != CM_NONE) {
+			break;
+		}
+	}
+	if (order >= CM_NORDERS) {
+		return CM_NONE;
+	}
 
-	size_t npages, csize;
+	frame = cm_freelist[order];
+	cm_list_remove(frame);
 
+	/* Split down to the size we want, freeing the upper halves. */
+	while (order > want) {
+		order--;
+		cm_list_add(frame + (1U << order), order);
+	}
+
+	for (i = 0; i < npages; i++) {
+		KASSERT(!coremap[frame + i].is_allocated);
+		coremap[frame + i].is_allocated = 1;
+	}
+	coremap[frame].block_length = npages;
+	coremap[frame].refcount = 1;
+
+	/* Give back whatever the power-of-two rounding took extra. */
+	cm_free_range(frame + npages, (1U << want) - npages);
+
+	cm_usedpages += npages;
+	if (cm_pageout_wchan != NULL &&
+	    sizeofmap - cm_firstframe - cm_usedpages < cm_lowater) {
+		wchan_wakeone(cm_pageout_wchan, &core_lock);
+	}
+	return frame;
+}
+
+/*
+ * Release the allocation whose head is FRAME.
+ */
+static
+void
+cm_free_frames(unsigned frame)
+{
+	unsigned npages, i;
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+	KASSERT(coremap[frame].is_allocated);
+
+	npages = coremap[frame].block_length;
+	KASSERT(npages > 0);
+	KASSERT(frame + npages <= sizeofmap);
+
+	for (i = 0; i < npages; i++) {
+		coremap[frame + i].is_allocated = 0;
+		coremap[frame + i].is_pinned = 0;
+		coremap[frame + i].block_length = 0;
+		coremap[frame + i].refcount = 0;
+	}
+	cm_free_range(frame, npages);
+
+	KASSERT(cm_usedpages >= npages);
+	cm_usedpages -= npages;
+}
+
+void initializeCoremap(void){
+
+	size_t csize;
 	paddr_t firstpaddr, lastpaddr;
+	unsigned i;
+
 	ram_getsize(&firstpaddr, &lastpaddr);
-	core_lock = (struct spinlock*)PADDR_TO_KVADDR(firstpaddr);
-	spinlock_init(core_lock);
-	size_t locksize = sizeof(struct spinlock);
-	locksize = ROUNDUP(locksize, PAGE_SIZE);
-	firstpaddr+= locksize;
-	npages = (lastpaddr - firstpaddr) / PAGE_SIZE;
 	KASSERT(firstpaddr!=0);
+
+	/* One entry for every frame of RAM, including the kernel's. */
+	sizeofmap = CM_FRAME(lastpaddr);
 	coremap = (struct coremap_entry*)PADDR_TO_KVADDR(firstpaddr);
-	if(coremap == NULL){
-		panic("Unable to create Coremap....\n");
-	}
-	csize = npages * sizeof(struct coremap_entry);
+	csize = sizeofmap * sizeof(struct coremap_entry);
 	csize = ROUNDUP(csize, PAGE_SIZE);
 	firstpaddr+= csize;
-	npages = (lastpaddr - firstpaddr) / PAGE_SIZE;
-	sizeofmap = npages;
-	for(unsigned i = 0; i < npages; i++){
-		coremap[i].ps_padder = firstpaddr+(i*PAGE_SIZE);
+	if (firstpaddr >= lastpaddr) {
+		panic("Unable to create Coremap....\n");
+	}
+	cm_firstframe = CM_FRAME(firstpaddr);
+
+	for(i = 0; i < sizeofmap; i++){
 		coremap[i].ps_swapaddr = 0;
+		coremap[i].owner = NULL;
+		coremap[i].owner_vaddr = 0;
+		coremap[i].block_length = 0;
+		coremap[i].refcount = 0;
+		coremap[i].next_free = CM_NONE;
+		coremap[i].prev_free = CM_NONE;
 		coremap[i].cpu_index = 0;
 		coremap[i].tlb_index = -1;
-		coremap[i].block_length = 0;
-		coremap[i].is_allocated = 0;
+		coremap[i].order = 0;
+		/* Frames below cm_firstframe are permanently in use. */
+		coremap[i].is_allocated = (i < cm_firstframe);
 		coremap[i].is_pinned = 0;
+		coremap[i].is_free_head = 0;
+		coremap[i].referenced = 0;
 	}
+	for (i = 0; i < CM_NORDERS; i++) {
+		cm_freelist[i] = CM_NONE;
+	}
+	cm_usedpages = 0;
+	cm_clockhand = cm_firstframe;
+
+	cm_lowater = (sizeofmap - cm_firstframe) / 32;
+	if (cm_lowater < CM_MINLOWATER) {
+		cm_lowater = CM_MINLOWATER;
+	}
+	cm_hiwater = 2 * cm_lowater;
+
+	spinlock_acquire(&core_lock);
+	cm_free_range(cm_firstframe, sizeofmap - cm_firstframe);
+	spinlock_release(&core_lock);
 }
 
-vaddr_t alloc_kpages(unsigned npages){
-	unsigned page_count = 0;
-	spinlock_acquire(core_lock);
-	for(unsigned i = 0; i<sizeofmap; i++){
-		if(coremap[i].is_allocated)
-			page_count = 0;
-		else
-			page_count++;
-		if(page_count == npages){
-			int start_index = i+1-npages;
-			coremap[start_index].block_length = npages;
-			for(unsigned j = start_index; j<=i; j++){
-				coremap[j].is_allocated = 1;
+/*
+ * Per-cpu page caches.
+ *
+ * Single-page allocations and frees go to the current cpu's
+ * c_pagecache first, so the usual page fault or kmalloc never touches
+ * core_lock. An empty cache is refilled, and a full one drained, in
+ * batches of CM_CACHE_BATCH pages under one acquisition of core_lock.
+ *
+ * Cached pages are marked allocated in the coremap, so they are
+ * subtracted back out in coremap_used_bytes(). When the coremap runs
+ * dry, cm_cache_reclaim() hands every cpu's cached pages back before
+ * giving up.
+ *
+ * Lock order: c_pagecache_lock, then core_lock.
+ */
+
+#define CM_CACHE_BATCH (CPU_PAGECACHE_MAX / 2)
+
+static
+unsigned
+cm_cache_alloc(struct cpu *c)
+{
+	unsigned frame;
+
+	spinlock_acquire(&c->c_pagecache_lock);
+	if (c->c_npagecache > 0) {
+		c->c_pagecache_hits++;
+	}
+	else {
+		c->c_pagecache_misses++;
+		spinlock_acquire(&core_lock);
+		while (c->c_npagecache < CM_CACHE_BATCH) {
+			frame = cm_alloc_frames(1);
+			if (frame == CM_NONE) {
+				break;
 			}
-			//kprintf("Allocating index: %d, for: %u pages\n",start_index, npages);
-			vaddr_t returnaddr = PADDR_TO_KVADDR(coremap[start_index].ps_padder);
-			spinlock_release(core_lock);
-			return returnaddr;
+			c->c_pagecache[c->c_npagecache++] = CM_PADDR(frame);
+		}
+		spinlock_release(&core_lock);
+		if (c->c_npagecache > 0) {
+			c->c_pagecache_refills++;
 		}
 	}
-	spinlock_release(core_lock);
-	return 0;
+
+	frame = CM_NONE;
+	if (c->c_npagecache > 0) {
+		frame = CM_FRAME(c->c_pagecache[--c->c_npagecache]);
+	}
+	spinlock_release(&c->c_pagecache_lock);
+
+	return frame;
+}
+
+static
+void
+cm_cache_free(struct cpu *c, unsigned frame)
+{
+	unsigned i;
+
+	spinlock_acquire(&c->c_pagecache_lock);
+	if (c->c_npagecache == CPU_PAGECACHE_MAX) {
+		spinlock_acquire(&core_lock);
+		for (i = 0; i < CM_CACHE_BATCH; i++) {
+			cm_free_frames(CM_FRAME(c->c_pagecache[--c->c_npagecache]));
+		}
+		spinlock_release(&core_lock);
+		c->c_pagecache_drains++;
+	}
+	c->c_pagecache[c->c_npagecache++] = CM_PADDR(frame);
+	spinlock_release(&c->c_pagecache_lock);
 }
+
+/*
+ * Return every cpu's cached pages to the coremap. Returns the number
+ * of pages recovered.
+ */
+static
+unsigned
+cm_cache_reclaim(void)
+{
+	struct cpu *c;
+	unsigned i, n = 0;
+
+	for (i = 0; (c = cpu_get(i)) != NULL; i++) {
+		spinlock_acquire(&c->c_pagecache_lock);
+		if (c->c_npagecache > 0) {
+			spinlock_acquire(&core_lock);
+			while (c->c_npagecache > 0) {
+				cm_free_frames(CM_FRAME(c->c_pagecache[--c->c_npagecache]));
+				n++;
+			}
+			spinlock_release(&core_lock);
+			c->c_pagecache_drains++;
+		}
+		spinlock_release(&c->c_pagecache_lock);
+	}
+	return n;
+}
+
+/*
+ * Take NPAGES frames, from the current cpu's cache if it's a single
+ * page. If the coremap is dry, pull back every cpu's cached pages and
+ * try once more.
+ */
+static
+unsigned
+cm_alloc(unsigned npages)
+{
+	unsigned frame;
+
+	if (npages == 1 && CURCPU_EXISTS()) {
+		frame = cm_cache_alloc(curcpu->c_self);
+	}
+	else {
+		spinlock_acquire(&core_lock);
+		frame = cm_alloc_frames(npages);
+		spinlock_release(&core_lock);
+	}
+
+	if (frame == CM_NONE && CURCPU_EXISTS() && cm_cache_reclaim() > 0) {
+		spinlock_acquire(&core_lock);
+		frame = cm_alloc_frames(npages);
+		spinlock_release(&core_lock);
+	}
+	return frame;
+}
+
+/*
+ * Give back a single page whose count has dropped to one with no
+ * owner left.
+ */
+static
+void
+cm_free_page(unsigned frame)
+{
+	KASSERT(coremap[frame].block_length == 1);
+	KASSERT(coremap[frame].refcount == 1);
+	KASSERT(coremap[frame].owner == NULL);
+
+	if (CURCPU_EXISTS()) {
+		cm_cache_free(curcpu->c_self, frame);
+		return;
+	}
+	spinlock_acquire(&core_lock);
+	cm_free_frames(frame);
+	spinlock_release(&core_lock);
+}
+
+vaddr_t alloc_kpages(unsigned npages){
+	unsigned frame;
+
+	if (npages == 0) {
+		return 0;
+	}
+
+	frame = cm_alloc(npages);
+	if (frame == CM_NONE) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(CM_PADDR(frame));
+}
+
 void free_kpages(vaddr_t addr){
-	paddr_t page_ad = KVADDR_TO_PADDR(addr);
-	unsigned i=0;
-	spinlock_acquire(core_lock);
-	for (i=0; i<sizeofmap; i++){
-		if(coremap[i].ps_padder == page_ad)
+	unsigned frame = CM_FRAME(KVADDR_TO_PADDR(addr));
+
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+	KASSERT(coremap[frame].is_allocated);
+
+	/*
+	 * A count of one can't change under us: nobody else holds a
+	 * reference to share it with. Anything higher may be dropping
+	 * concurrently in another address space.
+	 */
+	if (coremap[frame].refcount > 1) {
+		spinlock_acquire(&core_lock);
+		KASSERT(coremap[frame].refcount > 0);
+		if (--coremap[frame].refcount == 0) {
+			cm_free_frames(frame);
+		}
+		spinlock_release(&core_lock);
+		return;
+	}
+
+	if (coremap[frame].block_length == 1 && CURCPU_EXISTS()) {
+		cm_cache_free(curcpu->c_self, frame);
+		return;
+	}
+
+	spinlock_acquire(&core_lock);
+	cm_free_frames(frame);
+	spinlock_release(&core_lock);
+}
+
+void
+page_share(paddr_t paddr)
+{
+	unsigned frame = CM_FRAME(paddr);
+
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+
+	spinlock_acquire(&core_lock);
+	KASSERT(coremap[frame].is_allocated);
+	KASSERT(coremap[frame].block_length == 1);
+	KASSERT(coremap[frame].refcount > 0);
+	coremap[frame].refcount++;
+	spinlock_release(&core_lock);
+}
+
+unsigned
+page_refcount(paddr_t paddr)
+{
+	unsigned frame = CM_FRAME(paddr);
+
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+	return coremap[frame].refcount;
+}
+
+/*
+ * Paging.
+ *
+ * Every user frame records the address space and virtual address
+ * that map it (owner/owner_vaddr) so the pageout code can find its
+ * PTE. A frame shared copy-on-write has several mappers; it keeps
+ * whichever owner it had but is not a candidate for eviction until
+ * the count drops back to one. An owner that lets go of a frame
+ * clears the field, and the next fault through the surviving mapping
+ * claims it.
+ *
+ * When the coremap runs out, page_alloc evicts a victim chosen by the
+ * clock algorithm: the hand sweeps the coremap, skipping frames that
+ * are pinned, shared or not user pages, and gives each frame whose
+ * referenced bit is set (by vm_fault on every TLB refill) a second
+ * chance by clearing it. The victim is pinned while its owner's page
+ * table is updated and, if it holds data that swap doesn't, while it
+ * is written out. A pinned frame stays allocated; releasing its last
+ * reference from the owner waits for the pin to clear.
+ *
+ * A page read back from swap keeps its slot in ps_swapaddr, so if it
+ * is evicted again before being written it needs no I/O at all. A
+ * clean page with no swap copy has never been written, and is simply
+ * dropped to be zero-filled again on the next fault.
+ *
+ * Pages of shared file mappings never go to swap: a dirty one is
+ * written back to its file instead, and then, being clean, is dropped
+ * and read from the file again when next touched.
+ *
+ * Lock order: vfs_biglock, then cm_evict_lock, then an address space's
+ * as_lock, then tc_lock (the text cache's), then core_lock. The file
+ * system holds vfs_biglock while it copies to and from user memory,
+ * which can fault and evict, so no file I/O may be done while holding
+ * cm_evict_lock or any as_lock; nor may anything that can drop the last
+ * reference to a vnode, such as textcache_trim. Nobody may wait for a
+ * frame to unpin while holding the as_lock of that frame's owner.
+ */
+
+/*
+ * Invalidate VADDR in every cpu's TLB and wait until they all have.
+ * Called with cm_evict_lock held, so no cpu ever has more than one of
+ * our requests queued.
+ */
+static
+void
+vm_shootdown(vaddr_t vaddr)
+{
+	struct tlbshootdown ts;
+	struct cpu *c;
+	unsigned i, n = 0;
+	int spl, tlb_index;
+
+	KASSERT(lock_do_i_hold(cm_evict_lock));
+
+	ts.ts_vaddr = vaddr;
+	ts.ts_done = cm_shootdown_sem;
+
+	spl = splhigh();
+	tlb_index = tlb_probe(vaddr, 0);
+	if (tlb_index >= 0) {
+		tlb_write(TLBHI_INVALID(tlb_index), TLBLO_INVALID(), tlb_index);
+	}
+	for (i = 0; (c = cpu_get(i)) != NULL; i++) {
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, &ts);
+			n++;
+		}
+	}
+	splx(spl);
+
+	while (n-- > 0) {
+		P(cm_shootdown_sem);
+	}
+}
+
+/*
+ * Whether the page in E has been written since it was last in swap.
+ * The owner can't go away while it still owns the frame and we hold
+ * core_lock, so its page table is safe to look at; the answer is
+ * only a hint until its as_lock is taken.
+ */
+static
+bool
+cm_page_dirty(struct coremap_entry *e)
+{
+	uint32_t *pte;
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+	KASSERT(e->owner != NULL);
+
+	pte = get_pte(e->owner, e->owner_vaddr);
+	return pte != NULL && (*pte & PTE_DIRTY);
+}
+
+/*
+ * Advance the clock hand to the next evictable frame and pin it,
+ * returning its owner in ASRET and VADDRRET. If CLEANONLY is set,
+ * pages that would need writing out are passed over. Gives up with
+ * CM_NONE after two full sweeps, the most it can take when every
+ * frame has its referenced bit set.
+ */
+static
+unsigned
+cm_clock_select(struct addrspace **asret, vaddr_t *vaddrret, bool cleanonly)
+{
+	struct coremap_entry *e;
+	unsigned n, frame;
+
+	KASSERT(spinlock_do_i_hold(&core_lock));
+
+	for (n = 0; n < 2 * (sizeofmap - cm_firstframe); n++) {
+		frame = cm_clockhand;
+		if (++cm_clockhand >= sizeofmap) {
+			cm_clockhand = cm_firstframe;
+		}
+
+		e = &coremap[frame];
+		if (!e->is_allocated || e->is_pinned ||
+		    e->owner == NULL || e->refcount != 1) {
+			continue;
+		}
+		if (e->referenced) {
+			e->referenced = 0;
+			continue;
+		}
+		if (cleanonly && cm_page_dirty(e)) {
+			continue;
+		}
+
+		e->is_pinned = 1;
+		*asret = e->owner;
+		*vaddrret = e->owner_vaddr;
+		return frame;
+	}
+	return CM_NONE;
+}
+
+static
+void
+cm_unpin(unsigned frame)
+{
+	spinlock_acquire(&core_lock);
+	KASSERT(coremap[frame].is_pinned);
+	coremap[frame].is_pinned = 0;
+	wchan_wakeall(cm_pinwchan, &core_lock);
+	spinlock_release(&core_lock);
+}
+
+/*
+ * Whether pinned FRAME is still AS's page at VADDR and nobody else's,
+ * returning its PTE in PTEP. Called with AS's as_lock held.
+ */
+static
+bool
+cm_mine(unsigned frame, struct addrspace *as, vaddr_t vaddr, uint32_t **ptep)
+{
+	struct coremap_entry *e = &coremap[frame];
+	uint32_t *pte;
+	bool mine;
+
+	KASSERT(lock_do_i_hold(as->as_lock));
+
+	pte = get_pte(as, vaddr);
+	spinlock_acquire(&core_lock);
+	mine = pte != NULL && (*pte & PTE_VALID) &&
+		(*pte & PTE_FRAME) == CM_PADDR(frame) &&
+		e->refcount == 1 && e->owner == as;
+	spinlock_release(&core_lock);
+	*ptep = pte;
+	return mine;
+}
+
+/*
+ * Write pinned FRAME, the dirty page at VADDR in a shared file mapping
+ * of AS, back to its file, and mark it clean. Called with cm_evict_lock
+ * and AS's as_lock held. Both are dropped for the write (see the lock
+ * order above) and taken again before returning, so the caller has to
+ * look at the PTE again. The page is marked clean and its TLB entries
+ * taken away first, so a store made during the write dirties it again;
+ * if the write fails it's marked dirty again, if it's still there.
+ */
+static
+int
+cm_writeback(unsigned frame, struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t *pte;
+	int result;
+
+	KASSERT(lock_do_i_hold(cm_evict_lock));
+	KASSERT(lock_do_i_hold(as->as_lock));
+	KASSERT(coremap[frame].is_pinned);
+
+	pte = get_pte(as, vaddr);
+	KASSERT(pte != NULL && (*pte & PTE_FRAME) == CM_PADDR(frame));
+	*pte &= ~PTE_DIRTY;
+	vm_shootdown(vaddr);
+	lock_release(cm_evict_lock);
+
+	/* This releases as_lock. */
+	result = as_writeback(as, vaddr, CM_PADDR(frame));
+
+	lock_acquire(cm_evict_lock);
+	lock_acquire(as->as_lock);
+	if (result) {
+		pte = get_pte(as, vaddr);
+		if (pte != NULL && (*pte & PTE_VALID) &&
+		    (*pte & PTE_FRAME) == CM_PADDR(frame)) {
+			*pte |= PTE_DIRTY;
+		}
+	}
+	return result;
+}
+
+/*
+ * Take pinned FRAME away from AS, where it maps VADDR, paging it out
+ * first if need be. On success the frame is left allocated and pinned
+ * with no owner, for the caller to reuse. On failure it is unpinned.
+ * A dirty page of a shared file mapping is written back with the locks
+ * dropped, and given up on if it was written to again meanwhile.
+ */
+static
+int
+cm_evict(unsigned frame, struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e = &coremap[frame];
+	uint32_t *pte;
+	off_t swapaddr;
+	int result;
+
+	lock_acquire(as->as_lock);
+
+	/* It may have been shared or let go while we waited for the lock. */
+	if (!cm_mine(frame, as, vaddr, &pte)) {
+		lock_release(as->as_lock);
+		cm_unpin(frame);
+		return EAGAIN;
+	}
+
+	if ((*pte & PTE_DIRTY) && as_sharedfile(as, vaddr)) {
+		result = cm_writeback(frame, as, vaddr);
+		if (result == 0 && (!cm_mine(frame, as, vaddr, &pte) ||
+				    (*pte & PTE_DIRTY))) {
+			result = EAGAIN;
+		}
+		if (result) {
+			lock_release(as->as_lock);
+			cm_unpin(frame);
+			return result;
+		}
+	}
+
+	/*
+	 * PTE_DIRTY can't become set while we hold the lock, so we can
+	 * find a slot before going to the trouble of a shootdown.
+	 */
+	swapaddr = e->ps_swapaddr;
+	if ((*pte & PTE_DIRTY) && swapaddr == 0) {
+		result = swap_alloc(&swapaddr);
+		if (result) {
+			lock_release(as->as_lock);
+			cm_unpin(frame);
+			return result;
+		}
+	}
+
+	/* After this the owner can only get at the page by faulting. */
+	vm_shootdown(vaddr);
+
+	if (*pte & PTE_DIRTY) {
+		result = swap_pageout(CM_PADDR(frame), swapaddr);
+		if (result) {
+			/* Leave the page where it is; the slot stays with it. */
+			e->ps_swapaddr = swapaddr;
+			lock_release(as->as_lock);
+			cm_unpin(frame);
+			return result;
+		}
+	}
+
+	if (swapaddr != 0) {
+		*pte = swapaddr | (*pte & PTE_PERMS) | PTE_SWAPPED;
+	}
+	else {
+		/* Never written, or clean in its file: it'll be read again. */
+		*pte = 0;
+	}
+	lock_release(as->as_lock);
+
+	spinlock_acquire(&core_lock);
+	e->owner = NULL;
+	e->ps_swapaddr = 0;
+	e->referenced = 0;
+	/* Let a page_release from the old owner stop waiting. */
+	wchan_wakeall(cm_pinwchan, &core_lock);
+	spinlock_release(&core_lock);
+
+	return 0;
+}
+
+/*
+ * Free up a frame by evicting one. Returns it pinned, or CM_NONE if
+ * nothing can be evicted.
+ */
+static
+unsigned
+cm_evict_one(void)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	unsigned frame, tries, pass;
+
+	lock_acquire(cm_evict_lock);
+
+	/* Someone may have freed memory while we waited our turn. */
+	frame = cm_alloc(1);
+	if (frame != CM_NONE) {
+		lock_release(cm_evict_lock);
+		spinlock_acquire(&core_lock);
+		coremap[frame].is_pinned = 1;
+		spinlock_release(&core_lock);
+		return frame;
+	}
+
+	/*
+	 * The pageout daemon tries to keep clean pages around for us,
+	 * so look for one of those before writing anything out.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		for (tries = 0; tries < sizeofmap - cm_firstframe; tries++) {
+			spinlock_acquire(&core_lock);
+			frame = cm_clock_select(&as, &vaddr, pass == 0);
+			spinlock_release(&core_lock);
+			if (frame == CM_NONE) {
+				break;
+			}
+			if (cm_evict(frame, as, vaddr) == 0) {
+				cm_fault_evictions++;
+				lock_release(cm_evict_lock);
+				return frame;
+			}
+		}
+	}
+
+	lock_release(cm_evict_lock);
+	return CM_NONE;
+}
+
+/*
+ * Write pinned FRAME out to swap (or its file, for a shared mapping)
+ * but leave it mapped, so that it can later be evicted without any
+ * I/O. Always unpins it.
+ */
+static
+int
+cm_clean(unsigned frame, struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e = &coremap[frame];
+	uint32_t *pte;
+	off_t swapaddr;
+	bool newslot = false;
+	int result = 0;
+
+	lock_acquire(as->as_lock);
+
+	if (!cm_mine(frame, as, vaddr, &pte) || !(*pte & PTE_DIRTY)) {
+		goto out;
+	}
+
+	if (as_sharedfile(as, vaddr)) {
+		result = cm_writeback(frame, as, vaddr);
+		goto out;
+	}
+
+	swapaddr = e->ps_swapaddr;
+	if (swapaddr == 0) {
+		result = swap_alloc(&swapaddr);
+		if (result) {
+			goto out;
+		}
+		newslot = true;
+	}
+
+	/*
+	 * Take away any writeable TLB entry so the page holds still
+	 * while it's written; the owner's next store faults and sets
+	 * PTE_DIRTY again, after we're done.
+	 */
+	vm_shootdown(vaddr);
+	result = swap_pageout(CM_PADDR(frame), swapaddr);
+	if (result) {
+		if (newslot) {
+			swap_free(swapaddr);
+		}
+		goto out;
+	}
+	*pte &= ~PTE_DIRTY;
+	e->ps_swapaddr = swapaddr;
+
+ out:
+	lock_release(as->as_lock);
+	cm_unpin(frame);
+	return result;
+}
+
+/*
+ * Write the page at VADDR in AS back to its file if it's dirty, and
+ * mark it clean. The frame is pinned for the write, as in cm_clean; if
+ * the pageout code has it pinned already, wait for that to finish with
+ * nothing locked and look again.
+ */
+int
+page_sync(struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e;
+	uint32_t *pte;
+	unsigned frame;
+	int result;
+
+	while (1) {
+		lock_acquire(cm_evict_lock);
+		lock_acquire(as->as_lock);
+		pte = get_pte(as, vaddr);
+		if (pte == NULL || !(*pte & PTE_VALID) ||
+		    !(*pte & PTE_DIRTY)) {
+			lock_release(as->as_lock);
+			lock_release(cm_evict_lock);
+			return 0;
+		}
+		frame = CM_FRAME(*pte & PTE_FRAME);
+		e = &coremap[frame];
+
+		spinlock_acquire(&core_lock);
+		if (!e->is_pinned) {
+			e->is_pinned = 1;
+			spinlock_release(&core_lock);
 			break;
+		}
+		spinlock_release(&core_lock);
+
+		lock_release(as->as_lock);
+		lock_release(cm_evict_lock);
+		spinlock_acquire(&core_lock);
+		while (e->is_pinned) {
+			wchan_sleep(cm_pinwchan, &core_lock);
+		}
+		spinlock_release(&core_lock);
+	}
+
+	result = cm_writeback(frame, as, vaddr);
+	lock_release(as->as_lock);
+	lock_release(cm_evict_lock);
+	cm_unpin(frame);
+	return result;
+}
+
+/*
+ * Put an evicted frame straight back on the free lists.
+ */
+static
+void
+cm_evict_free(unsigned frame)
+{
+	spinlock_acquire(&core_lock);
+	KASSERT(coremap[frame].is_pinned);
+	KASSERT(coremap[frame].owner == NULL);
+	cm_free_frames(frame);
+	wchan_wakeall(cm_pinwchan, &core_lock);
+	spinlock_release(&core_lock);
+}
+
+/*
+ * One round of the pageout daemon: run the clock until there are
+ * cm_hiwater free frames or it has gone round twice. Unreferenced
+ * clean pages are freed; unreferenced dirty ones are written out and
+ * left in place, to be freed on a later sweep if they are still
+ * unused by then. cm_evict_lock is dropped every CM_PAGEOUT_BATCH
+ * pages so faults that need to evict don't wait behind a whole round.
+ * Cached program text that no process is running goes first, since
+ * dropping it costs no I/O.
+ * Returns the number of pages freed or cleaned.
+ */
+static
+unsigned
+cm_reclaim(void)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	unsigned frame, scanned, n, nfree, progress = 0;
+	bool dirty, done = false;
+
+	spinlock_acquire(&core_lock);
+	nfree = sizeofmap - cm_firstframe - cm_usedpages;
+	spinlock_release(&core_lock);
+	if (nfree < cm_hiwater) {
+		progress += textcache_trim(cm_hiwater - nfree);
 	}
-	if(coremap[i].ps_padder == page_ad){
-		KASSERT(coremap[i].is_allocated);
-		int j = coremap[i].block_length;
-		for(int k=0; k<j; k++){
-			coremap[i+k].is_allocated = 0;
-			coremap[i+k].block_length = 0;
-			//kprintf("Freeing index: %d\n", (i+k));
+
+	for (scanned = 0; !done && scanned < 2 * (sizeofmap - cm_firstframe);
+	     scanned += n) {
+		lock_acquire(cm_evict_lock);
+		for (n = 0; n < CM_PAGEOUT_BATCH; n++) {
+			spinlock_acquire(&core_lock);
+			if (sizeofmap - cm_firstframe - cm_usedpages >= cm_hiwater) {
+				frame = CM_NONE;
+			}
+			else {
+				frame = cm_clock_select(&as, &vaddr, false);
+			}
+			dirty = frame != CM_NONE && cm_page_dirty(&coremap[frame]);
+			spinlock_release(&core_lock);
+			if (frame == CM_NONE) {
+				done = true;
+				break;
+			}
+
+			if (dirty) {
+				if (cm_clean(frame, as, vaddr) == 0) {
+					cm_pageout_cleaned++;
+					progress++;
+				}
+			}
+			else if (cm_evict(frame, as, vaddr) == 0) {
+				cm_evict_free(frame);
+				cm_pageout_freed++;
+				progress++;
+			}
 		}
+		lock_release(cm_evict_lock);
 	}
-	spinlock_release(core_lock);
+	return progress;
+}
+
+/*
+ * Pageout daemon.
+ *
+ * Sleeps until an allocation leaves fewer than cm_lowater frames free,
+ * then reclaims up to cm_hiwater, so that page faults normally find a
+ * free frame, or failing that a clean one to take, without waiting
+ * for a disk write. Faults only evict synchronously when memory is
+ * being used faster than this thread can reclaim it.
+ */
+static
+void
+vm_pageout(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
 
+	while (1) {
+		spinlock_acquire(&core_lock);
+		while (sizeofmap - cm_firstframe - cm_usedpages >= cm_lowater) {
+			wchan_sleep(cm_pageout_wchan, &core_lock);
+		}
+		spinlock_release(&core_lock);
+
+		cm_pageout_runs++;
+		if (cm_reclaim() == 0) {
+			/* Nothing we can take right now; don't spin. */
+			clocksleep(1);
+		}
+	}
+}
+
+paddr_t
+page_alloc(struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e;
+	unsigned frame;
+
+	KASSERT(as != NULL);
+	KASSERT(!lock_do_i_hold(as->as_lock));
+
+	frame = cm_alloc(1);
+	if (frame == CM_NONE && textcache_trim(1) > 0) {
+		frame = cm_alloc(1);
+	}
+	if (frame != CM_NONE) {
+		spinlock_acquire(&core_lock);
+		coremap[frame].is_pinned = 1;
+		spinlock_release(&core_lock);
+	}
+	else {
+		frame = cm_evict_one();
+		if (frame == CM_NONE) {
+			return 0;
+		}
+	}
+
+	e = &coremap[frame];
+	spinlock_acquire(&core_lock);
+	KASSERT(e->is_pinned);
+	KASSERT(e->refcount == 1);
+	KASSERT(e->owner == NULL);
+	e->owner = as;
+	e->owner_vaddr = vaddr;
+	e->ps_swapaddr = 0;
+	e->referenced = 1;
+	spinlock_release(&core_lock);
+
+	return CM_PADDR(frame);
 }
 
+void
+page_unpin(paddr_t paddr)
+{
+	unsigned frame = CM_FRAME(paddr);
+
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+	cm_unpin(frame);
+}
+
+/*
+ * Hand back a pinned frame from page_alloc that never got mapped.
+ */
+static
+void
+cm_discard(paddr_t paddr)
+{
+	unsigned frame = CM_FRAME(paddr);
+	struct coremap_entry *e = &coremap[frame];
+
+	spinlock_acquire(&core_lock);
+	KASSERT(e->is_pinned);
+	KASSERT(e->refcount == 1);
+	KASSERT(e->ps_swapaddr == 0);
+	e->owner = NULL;
+	e->is_pinned = 0;
+	wchan_wakeall(cm_pinwchan, &core_lock);
+	spinlock_release(&core_lock);
+
+	cm_free_page(frame);
+}
+
+bool
+page_release(paddr_t paddr, struct addrspace *as)
+{
+	unsigned frame = CM_FRAME(paddr);
+	struct coremap_entry *e = &coremap[frame];
+	off_t swapaddr;
+
+	KASSERT(frame >= cm_firstframe && frame < sizeofmap);
+
+	spinlock_acquire(&core_lock);
+	KASSERT(e->is_allocated);
+	KASSERT(e->refcount > 0);
+
+	if (e->is_pinned && e->owner == as) {
+		/* Being evicted from under us; see where it ends up. */
+		while (e->is_pinned && e->owner == as) {
+			wchan_sleep(cm_pinwchan, &core_lock);
+		}
+		spinlock_release(&core_lock);
+		return false;
+	}
+
+	if (e->owner == as) {
+		e->owner = NULL;
+	}
+	if (--e->refcount > 0) {
+		spinlock_release(&core_lock);
+		return true;
+	}
+
+	/* Last reference. Nobody else can see the frame now. */
+	KASSERT(!e->is_pinned);
+	KASSERT(e->owner == NULL);
+	swapaddr = e->ps_swapaddr;
+	e->ps_swapaddr = 0;
+	e->referenced = 0;
+	e->refcount = 1;
+	spinlock_release(&core_lock);
+
+	if (swapaddr != 0) {
+		swap_free(swapaddr);
+	}
+	cm_free_page(frame);
+	return true;
+}
+
+/*
+ * Start paging. The coremap itself is set up much earlier, by
+ * initializeCoremap; this runs once threads and devices are up.
+ */
 void
 vm_bootstrap(void)
 {
-	initializeCoremap();
+	struct wchan *wc;
+	int result;
+
+	cm_evict_lock = lock_create("evict");
+	cm_shootdown_sem = sem_create("shootdown", 0);
+	cm_pinwchan = wchan_create("cmpin");
+	wc = wchan_create("pageout");
+	if (cm_evict_lock == NULL || cm_shootdown_sem == NULL ||
+	    cm_pinwchan == NULL || wc == NULL) {
+		panic("vm_bootstrap: Out of memory\n");
+	}
+
+	swap_bootstrap();
+
+	result = thread_fork("pageout", NULL, vm_pageout, NULL, 0);
+	if (result) {
+		panic("vm_bootstrap: thread_fork: %s\n", strerror(result));
+	}
+
+	/* Allocations only start waking the daemon once it exists. */
+	spinlock_acquire(&core_lock);
+	cm_pageout_wchan = wc;
+	spinlock_release(&core_lock);
 }
 
 unsigned
 int
 coremap_used_bytes() {
 
-	int count = 0;
-	for(unsigned i = 0; i<sizeofmap; i++){
-		if(coremap[i].is_allocated){
-			count++;
-		}
+	struct cpu *c;
+	unsigned i, used, cached = 0;
+
+	/* Pages sitting in the per-cpu caches are free. */
+	for (i = 0; (c = cpu_get(i)) != NULL; i++) {
+		cached += c->c_npagecache;
 	}
-	//kprintf("No. of used pages: %d. Total pages: %u\n", count, sizeofmap);
-	unsigned int used = count*PAGE_SIZE;
 
-	return used;
+	spinlock_acquire(&core_lock);
+	used = cm_usedpages;
+	spinlock_release(&core_lock);
+
+	if (cached > used) {
+		return 0;
+	}
+	return (used - cached) * PAGE_SIZE;
+}
+
+/*
+ * Print per-cpu page cache statistics.
+ */
+void
+coremap_printcachestats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("cpu   cached     hits   misses  refills   drains\n");
+	for (i = 0; (c = cpu_get(i)) != NULL; i++) {
+		spinlock_acquire(&c->c_pagecache_lock);
+		kprintf("%3u %8u %8u %8u %8u %8u\n", c->c_number,
+			c->c_npagecache, c->c_pagecache_hits,
+			c->c_pagecache_misses, c->c_pagecache_refills,
+			c->c_pagecache_drains);
+		spinlock_release(&c->c_pagecache_lock);
+	}
+	kprintf("coremap: %u of %u pages in use\n",
+		coremap_used_bytes() / PAGE_SIZE, sizeofmap - cm_firstframe);
+	kprintf("pageout: watermarks %u/%u, %u runs, %u cleaned, %u freed; "
+		"%u evictions in faults\n", cm_lowater, cm_hiwater,
+		cm_pageout_runs, cm_pageout_cleaned, cm_pageout_freed,
+		cm_fault_evictions);
+	swap_printstats();
+	textcache_printstats();
 }
 
+/*
+ * vm_shootdown never has more than one request outstanding per cpu,
+ * so the queue can't overflow into this; if it somehow did, flushing
+ * everything would still be correct.
+ */
 void
 vm_tlbshootdown_all(void)
 {
-	panic("You tried to do tlb shootdown?!\n");
+	int i, spl;
+
+	spl = splhigh();
+	for (i = 0; i < NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	splx(spl);
 }
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("You tried to do tlb shootdown?!\n");
+	int spl, tlb_index;
+
+	spl = splhigh();
+	tlb_index = tlb_probe(ts->ts_vaddr, 0);
+	if (tlb_index >= 0) {
+		tlb_write(TLBHI_INVALID(tlb_index), TLBLO_INVALID(), tlb_index);
+	}
+	splx(spl);
+
+	V(ts->ts_done);
 }
 
+/*
+ * Page fault handler.
+ *
+ * The page table always holds the truth; the TLB is only a cache of
+ * it. A TLB miss on an unmapped page in a valid region allocates a
+ * frame and fills it, from the executable for program segments (exec
+ * reads nothing up front) and with zeros otherwise, or reads the page
+ * back if it was swapped out. Read-only program text is looked up in
+ * the text cache first, and a page read from the file goes into it,
+ * so that processes running the same program share one copy.
+ * Pages are entered in the TLB without TLBLO_DIRTY until they are
+ * first written, so that PTE_DIRTY records which pages have been
+ * modified; the first store to a writeable page then comes back here
+ * as VM_FAULT_READONLY and sets it. That is also where copy-on-write
+ * pages get their private copy.
+ *
+ * Frames are allocated with the address space unlocked, since finding
+ * one may mean evicting a page of ours, and pages are read from files
+ * with it unlocked too, so the page table is looked at again after
+ * each.
+ */
 int vm_fault(int faulttype, vaddr_t faultaddress){
-	
-	bool valid = false;
-	struct addrspace *as = proc_getas();
-	bool page_permission[3];
+
+	struct addrspace *as;
+	struct coremap_entry *e;
+	struct vnode *textvn;
+	uint32_t *pte, perms;
 	uint32_t tlbhi, tlblo;
+	paddr_t newpage = 0, oldpage = 0, sharedpage = 0;
+	unsigned textgen = 0;
+	bool needpage;
+	int spl, tlb_index, result;
 
-	if (as == NULL)
-		return EFAULT;
-	faultaddress &= PAGE_FRAME;
-	
-	//Check if the address is valid
-	struct regions *curr_region = as->regionlist;
-	while(curr_region!=NULL){
-		if(faultaddress>=curr_region->vbase && faultaddress<=(curr_region->vbase+curr_region->npages*PAGE_SIZE)){
-			valid = true;
-			for(int i=0; i<3; i++)
-				page_permission[i] = curr_region->permissions+i;
+	switch(faulttype){
+		case VM_FAULT_READONLY:
+		case VM_FAULT_WRITE:
+		case VM_FAULT_READ:
 			break;
-		}
-		curr_region=curr_region->next;
-	}
-	if (faultaddress >= USERSTACK - PAGE_SIZE * STACKPAGES){
-		page_permission[0] = 1;
-		page_permission[1] = 1;
-		valid = true;
+		default:
+			return EINVAL;
 	}
 
-	if(!valid)
+	if (curproc == NULL)
 		return EFAULT;
+	as = proc_getas();
+	if (as == NULL)
+		return EFAULT;
+	faultaddress &= PAGE_FRAME;
 
-	struct pagetable_entry *pte = get_pte(as, faultaddress);
+	//Check if the address is valid
+	perms = as_perms(as, faultaddress);
+	if (perms == 0)
+		return EFAULT;
 
 	//Check if we have the required permission
-	int spl = splhigh();
-
-	switch(faulttype){
-		case VM_FAULT_READONLY:
-			//Check if we can write to the page
-			if(!page_permission[1] || !as->loading){
-				return EFAULT;
-			}
-
-			//Set the entries to be written to TLB
-			vaddr_t pbase = pte->paddr<<12;
-//////////////////////////////////////////////////////////////////////////////////// pbase type
-			tlbhi = faultaddress & TLBHI_VPAGE;
-			tlblo = (pbase & TLBLO_PPAGE) | TLBLO_DIRTY | TLBLO_VALID;
+	if (faulttype != VM_FAULT_READ && !(perms & PTE_WRITE) && !as->loading)
+		return EFAULT;
 
-			//Get the tlb index for the page
-			int tlb_index = tlb_probe(faultaddress, 0);
-			if (tlb_index < 0) {
-				tlb_random(tlbhi, tlblo);
+	lock_acquire(as->as_lock);
+	textvn = as->loading ? NULL : as_textvnode(as, faultaddress);
+	while (1) {
+		pte = get_pte(as, faultaddress);
+		if (pte == NULL || !(*pte & PTE_VALID)) {
+			needpage = true;
+			if (textvn != NULL &&
+			    (pte == NULL || !(*pte & PTE_SWAPPED))) {
+				sharedpage = textcache_lookup(textvn,
+							      faultaddress);
 			}
-			else {
-				tlb_write(tlbhi, tlblo, tlb_index);
+			if (sharedpage != 0) {
+				break;
 			}
+		}
+		else {
+			needpage = faulttype != VM_FAULT_READ &&
+				(*pte & PTE_COW) &&
+				page_refcount(*pte & PTE_FRAME) > 1;
+		}
+		if (!needpage || newpage != 0) {
+			break;
+		}
+		lock_release(as->as_lock);
+		newpage = page_alloc(as, faultaddress);
+		if (newpage == 0)
+			return ENOMEM;
+		lock_acquire(as->as_lock);
+	}
 
-			splx(spl);
+	if (sharedpage != 0) {
+		//Another process running this program already read it
+		result = pte_insert(as, faultaddress, sharedpage,
+				    perms | PTE_VALID);
+		if (result) {
+			lock_release(as->as_lock);
+			page_release(sharedpage, as);
+			if (newpage != 0) {
+				cm_discard(newpage);
+			}
+			return result;
+		}
+		pte = get_pte(as, faultaddress);
+	}
+	else if (pte != NULL && (*pte & PTE_SWAPPED)) {
+		//Read it back in; the slot stays as its clean copy
+		result = swap_pagein(newpage, *pte & PTE_FRAME);
+		if (result) {
+			lock_release(as->as_lock);
+			cm_discard(newpage);
+			return result;
+		}
+		coremap[CM_FRAME(newpage)].ps_swapaddr = *pte & PTE_FRAME;
+		*pte = newpage | (*pte & PTE_PERMS) | PTE_VALID;
+		page_unpin(newpage);
+		newpage = 0;
+	}
+	else if (pte == NULL || !(*pte & PTE_VALID)) {
+		//First touch: zeros, or the page's part of the executable.
+		//The file is read unlocked (see the lock order above); the
+		//frame is pinned and not yet mapped, so nobody can take it.
+		if (textvn != NULL) {
+			textgen = textcache_generation(textvn);
+		}
+		lock_release(as->as_lock);
+		result = as_fill_page(as, faultaddress, newpage);
+		if (result) {
+			cm_discard(newpage);
+			return result;
+		}
+		lock_acquire(as->as_lock);
+		pte = get_pte(as, faultaddress);
+		if (pte != NULL && (*pte & (PTE_VALID | PTE_SWAPPED))) {
+			//Mapped while we read; fault again and use that
+			lock_release(as->as_lock);
+			cm_discard(newpage);
 			return 0;
-
-		case VM_FAULT_WRITE: break;
-		case VM_FAULT_READ: break;
-		default:
-			return EINVAL;
+		}
+		result = pte_insert(as, faultaddress, newpage,
+				    perms | PTE_VALID);
+		if (result) {
+			lock_release(as->as_lock);
+			cm_discard(newpage);
+			return result;
+		}
+		pte = get_pte(as, faultaddress);
+		if (textvn != NULL) {
+			textcache_insert(textvn, faultaddress, newpage,
+					 textgen);
+		}
+		page_unpin(newpage);
+		newpage = 0;
+	}
+	else if (needpage) {
+		//Copy-on-write page still shared: take a private copy
+		oldpage = *pte & PTE_FRAME;
+		memcpy((void *)PADDR_TO_KVADDR(newpage),
+		       (void *)PADDR_TO_KVADDR(oldpage), PAGE_SIZE);
+		*pte = newpage | (*pte & ~(PTE_FRAME | PTE_COW));
+		page_unpin(newpage);
+		newpage = 0;
 	}
 
-	//VM_FAULT_READ or WRITE. No TLB entry found
-	//Check if page is allocated
-	if(pte == NULL){
-		//Allocating page for the first time
-		vaddr_t newpage = alloc_kpages(1);
-		if(newpage==0)
-			return ENOMEM;
+	if (faulttype != VM_FAULT_READ) {
+		//Nobody else has it any more, so it's ours to write
+		*pte &= ~PTE_COW;
+		*pte |= PTE_DIRTY;
+	}
+	if (as->loading) {
+		//Loading writes through the TLB without faulting
+		*pte |= PTE_DIRTY;
+	}
 
-		pte_insert(as, faultaddress, newpage, page_permission);
+	e = &coremap[CM_FRAME(*pte & PTE_FRAME)];
+	e->referenced = 1;
+	if (e->owner == NULL && e->refcount == 1) {
+		spinlock_acquire(&core_lock);
+		if (e->owner == NULL && e->refcount == 1) {
+			e->owner = as;
+			e->owner_vaddr = faultaddress;
+		}
+		spinlock_release(&core_lock);
+	}
 
-		tlbhi = faultaddress & TLBHI_VPAGE;
-		tlblo = (newpage & TLBLO_PPAGE) | TLBLO_VALID;
-		/////////////////////////////////////////////////////////////////////////newpage type
-		tlb_random(tlbhi, tlblo);
+	tlbhi = faultaddress & TLBHI_VPAGE;
+	tlblo = (*pte & TLBLO_PPAGE) | TLBLO_VALID;
+	if ((*pte & PTE_DIRTY) && !(*pte & PTE_COW)) {
+		tlblo |= TLBLO_DIRTY;
 	}
 
-	else{
-		//Page allocated but not in TLB
-		vaddr_t pbase = pte->paddr<<12;
-		tlbhi = faultaddress & TLBHI_VPAGE;
-		tlblo = (pbase & TLBLO_PPAGE) | TLBLO_VALID;
+	spl = splhigh();
+	tlb_index = tlb_probe(faultaddress, 0);
+	if (tlb_index < 0) {
 		tlb_random(tlbhi, tlblo);
 	}
-
+	else {
+		tlb_write(tlbhi, tlblo, tlb_index);
+	}
 	splx(spl);
+
+	lock_release(as->as_lock);
+
+	if (newpage != 0) {
+		//Raced with the other side letting go; didn't need it
+		cm_discard(newpage);
+	}
+	if (oldpage != 0) {
+		while (!page_release(oldpage, as)) {
+			/* retry */
+		}
+	}
 	return 0;
 }
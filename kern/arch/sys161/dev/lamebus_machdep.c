@@ -75,6 +75,54 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read c0_count ($9).
+ */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Bounds for one-shot timer settings, in cycles. Too short and
+ * c0_count might get past the new c0_compare before it's written,
+ * and we'd wait for it to wrap; too long and count + cycles could
+ * overflow.
+ */
+#define TIMER_MINCYCLES 500
+#define TIMER_MAXCYCLES 0x7fffffff
+
+/*
+ * On System/161, c0_count goes back to zero when it reaches
+ * c0_compare, which is how writing the same value every time gives us
+ * a periodic interrupt. For a one-shot setting we count on from where
+ * it is now.
+ */
+void
+mainbus_settimer(uint64_t nsecs)
+{
+	uint64_t cycles;
+
+	cycles = nsecs / (1000000000 / CPU_FREQUENCY);
+	if (cycles < TIMER_MINCYCLES) {
+		cycles = TIMER_MINCYCLES;
+	}
+	if (cycles > TIMER_MAXCYCLES) {
+		cycles = TIMER_MAXCYCLES;
+	}
+	mips_timer_set(mips_timer_count() + (uint32_t)cycles);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -304,7 +352,11 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
+		/*
+		 * Reset the timer (this clears the interrupt). This
+		 * makes it periodic again; hardclock will reprogram
+		 * it if it's keeping track of deadlines.
+		 */
 		mips_timer_set(CPU_FREQUENCY / HZ);
 		/* and call hardclock */
 		hardclock();
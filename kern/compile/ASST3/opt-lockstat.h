@@ -0,0 +1 @@
+#define OPT_LOCKSTAT 0
@@ -36,9 +36,13 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
-#include <synch.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <current.h>
+#include <clock.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <blkq.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -60,6 +64,9 @@
 /* Buffer (offset within slot)  */
 #define LHD_BUFFER      32768
 
+/* Sectors per trip through the bounce buffer for user I/O */
+#define LHD_BOUNCESECTS 8
+
 /*
  * Shortcut for reading a register.
  */
@@ -96,27 +103,91 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * One caller's transfer. Lives on the caller's stack while it sleeps.
+ * The uio always describes kernel memory, so the interrupt handler
+ * can copy through it.
+ */
+struct lhd_request {
+	struct blkq_req lr_bq;		/* must be first */
+	uint32_t lr_sector;		/* next sector to transfer */
+	uint32_t lr_nsect;		/* sectors still to go */
+	struct uio *lr_uio;
+	int lr_result;
+	bool lr_done;
+	struct thread *lr_thread;	/* who's waiting for it */
+};
+
+/*
+ * Start the next sector of the active request. For a write that means
+ * filling the card buffer first. Called with lh_lock held.
  */
 static
 void
-lhd_iodone(struct lhd_softc *lh, int err)
+lhd_startsect(struct lhd_softc *lh)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct lhd_request *lr = lh->lh_active;
+	uint32_t statval = LHD_WORKING;
+	int result;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+	KASSERT(lr != NULL && lr->lr_nsect > 0);
+
+	if (lr->lr_uio->uio_rw == UIO_WRITE) {
+		/* Kernel memory; this can't fail. */
+		result = uiomove(lh->lh_buf, LHD_SECTSIZE, lr->lr_uio);
+		KASSERT(result == 0);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, lr->lr_sector);
+
+	/* and start the operation. */
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * Make the request the scheduler picks next active and start it. One
+ * that begins where the last transfer left off continues it with no
+ * seek; those are counted as coalesced. Called with lh_lock held.
+ */
+static
+void
+lhd_startnext(struct lhd_softc *lh)
+{
+	struct blkq_req *br;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+	KASSERT(lh->lh_active == NULL);
+
+	br = blkq_next(&lh->lh_blkq, lh->lh_nextsect);
+	if (br == NULL) {
+		return;
+	}
+
+	lh->lh_active = (struct lhd_request *)br;
+	if (lh->lh_active->lr_sector == lh->lh_nextsect) {
+		lh->lh_ncoalesced++;
+	}
+	lhd_startsect(lh);
 }
 
 /*
  * Interrupt handler for lhd.
  * Read the status register; if an operation finished, clear the status
- * register and report completion.
+ * register, move the data, and start the next sector or request
+ * before returning.
  */
 void
 lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
+	struct lhd_request *lr;
 	uint32_t val;
+	int err;
+
+	spinlock_acquire(&lh->lh_lock);
 
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
@@ -128,9 +199,42 @@ lhd_irq(void *vlh)
 	    case LHD_INVSECT:
 	    case LHD_MEDIA:
 		lhd_wreg(lh, LHD_REG_STAT, 0);
-		lhd_iodone(lh, lhd_code_to_errno(lh, val));
+		lh->lh_nintrs++;
+
+		lr = lh->lh_active;
+		if (lr == NULL) {
+			/* Nothing of ours; spurious. */
+			break;
+		}
+
+		err = lhd_code_to_errno(lh, val);
+		if (err == 0 && lr->lr_uio->uio_rw == UIO_READ) {
+			membar_load_load();
+			err = uiomove(lh->lh_buf, LHD_SECTSIZE, lr->lr_uio);
+		}
+		if (err == 0) {
+			lr->lr_sector++;
+			lr->lr_nsect--;
+			lh->lh_nsectors++;
+			lh->lh_nextsect = lr->lr_sector;
+		}
+
+		if (err == 0 && lr->lr_nsect > 0) {
+			lhd_startsect(lh);
+			break;
+		}
+
+		lr->lr_result = err;
+		lr->lr_done = true;
+		lh->lh_active = NULL;
+		lh->lh_nrequests++;
+		blkq_done(&lh->lh_blkq, &lr->lr_bq);
+		wchan_wakethread(lh->lh_wchan, &lh->lh_lock, lr->lr_thread);
+		lhd_startnext(lh);
 		break;
 	}
+
+	spinlock_release(&lh->lh_lock);
 }
 
 /*
@@ -179,8 +283,50 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Queue a transfer of whole sectors to or from kernel memory and wait
+ * for it to finish.
+ */
+static
+int
+lhd_submit(struct lhd_softc *lh, struct uio *uio)
+{
+	struct lhd_request lr;
+
+	KASSERT(uio->uio_segflg == UIO_SYSSPACE);
+
+	lr.lr_sector = uio->uio_offset / LHD_SECTSIZE;
+	lr.lr_nsect = uio->uio_resid / LHD_SECTSIZE;
+	lr.lr_uio = uio;
+	lr.lr_result = 0;
+	lr.lr_done = false;
+	lr.lr_thread = curthread;
+
+	if (lr.lr_nsect == 0) {
+		return 0;
+	}
+
+	spinlock_acquire(&lh->lh_lock);
+	blkq_add(&lh->lh_blkq, &lr.lr_bq, lr.lr_sector,
+		 uio->uio_rw == UIO_WRITE);
+	if (lh->lh_active == NULL) {
+		lhd_startnext(lh);
+	}
+	while (!lr.lr_done) {
+		wchan_sleep(lh->lh_wchan, &lh->lh_lock);
+	}
+	spinlock_release(&lh->lh_lock);
+
+	return lr.lr_result;
+}
+
 /*
  * I/O function (for both reads and writes)
+ *
+ * Kernel buffers are handed to the device as they are, in one request
+ * however many sectors and iovecs they span. User buffers can't be
+ * touched from the interrupt handler, so they go through a kernel
+ * bounce buffer LHD_BOUNCESECTS sectors at a time.
  */
 static
 int
@@ -192,9 +338,11 @@ lhd_io(struct device *d, struct uio *uio)
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
-	int result;
+	struct iovec iov;
+	struct uio ku;
+	char *bounce;
+	size_t n;
+	int result = 0;
 
 	/* Don't allow I/O that isn't sector-aligned. */
 	if (sectoff != 0 || lenoff != 0) {
@@ -202,72 +350,95 @@ lhd_io(struct device *d, struct uio *uio)
 	}
 
 	/* Don't allow I/O past the end of the disk. */
-	/* XXX this check can overflow */
-	if (sector+len > lh->lh_dev.d_blocks) {
+	if (sector > lh->lh_dev.d_blocks ||
+	    len > lh->lh_dev.d_blocks - sector) {
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		return lhd_submit(lh, uio);
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	bounce = kmalloc(LHD_BOUNCESECTS * LHD_SECTSIZE);
+	if (bounce == NULL) {
+		return ENOMEM;
+	}
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+	while (result == 0 && uio->uio_resid > 0) {
+		n = uio->uio_resid;
+		if (n > LHD_BOUNCESECTS * LHD_SECTSIZE) {
+			n = LHD_BOUNCESECTS * LHD_SECTSIZE;
+		}
+		uio_kinit(&iov, &ku, bounce, n, uio->uio_offset, uio->uio_rw);
 
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
 		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
+			result = uiomove(bounce, n, uio);
 			if (result) {
-				V(lh->lh_clear);
-				return result;
+				break;
 			}
 		}
-
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
-
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
-
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
-
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+		result = lhd_submit(lh, &ku);
+		if (result == 0 && uio->uio_rw == UIO_READ) {
+			result = uiomove(bounce, n, uio);
 		}
+	}
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
+	kfree(bounce);
+	return result;
+}
 
-		/* If we failed, return the error. */
-		if (result) {
-			return result;
-		}
-	}
+/*
+ * Print request, sector and interrupt counts, and their rates since
+ * the device was attached.
+ */
+static
+void
+lhd_printstats(struct device *d)
+{
+	struct lhd_softc *lh = d->d_data;
+	struct timespec now, elapsed;
+	unsigned nreq, ncoal, nsect, nintr, secs;
+
+	spinlock_acquire(&lh->lh_lock);
+	nreq = lh->lh_nrequests;
+	ncoal = lh->lh_ncoalesced;
+	nsect = lh->lh_nsectors;
+	nintr = lh->lh_nintrs;
+	spinlock_release(&lh->lh_lock);
+
+	gettime(&now);
+	timespec_sub(&now, &lh->lh_starttime, &elapsed);
+	secs = elapsed.tv_sec > 0 ? elapsed.tv_sec : 1;
+
+	kprintf("    %u requests (%u coalesced), %u sectors, "
+		"%u interrupts\n", nreq, ncoal, nsect, nintr);
+	kprintf("    %u requests/s, %u sectors/s, %u interrupts/s "
+		"over %u s\n", nreq / secs, nsect / secs, nintr / secs, secs);
+	blkq_printstats(&lh->lh_blkq);
+}
 
-	return 0;
+/*
+ * Choose the I/O scheduler.
+ */
+static
+int
+lhd_setsched(struct device *d, const char *name)
+{
+	struct lhd_softc *lh = d->d_data;
+	int result;
+
+	spinlock_acquire(&lh->lh_lock);
+	result = blkq_setpolicy(&lh->lh_blkq, name);
+	spinlock_release(&lh->lh_lock);
+	return result;
 }
 
 static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_printstats = lhd_printstats,
+	.devop_setsched = lhd_setsched,
 };
 
 /*
@@ -284,17 +455,22 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
-	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_wchan = wchan_create("lhd");
+	if (lh->lh_wchan == NULL) {
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
+	lh->lh_active = NULL;
+	blkq_init(&lh->lh_blkq);
+	lh->lh_nextsect = 0;
+
+	gettime(&lh->lh_starttime);
+	lh->lh_nrequests = 0;
+	lh->lh_ncoalesced = 0;
+	lh->lh_nsectors = 0;
+	lh->lh_nintrs = 0;
 
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_ops = &lhd_devops;
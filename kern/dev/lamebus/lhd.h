@@ -30,7 +30,10 @@
 #ifndef _LAMEBUS_LHD_H_
 #define _LAMEBUS_LHD_H_
 
+#include <kern/time.h>
+#include <spinlock.h>
 #include <device.h>
+#include <blkq.h>
 
 /*
  * Our sector size
@@ -39,7 +42,17 @@
 
 /*
  * Hardware device data associated with lhd (LAMEbus hard disk)
+ *
+ * Callers queue requests of any number of contiguous sectors on
+ * lh_blkq, whose policy picks the order they run in, and sleep on
+ * lh_wchan. The interrupt handler moves each sector between the card
+ * buffer and the request's buffer and starts the next sector right
+ * away, so a thread only runs once per request rather than once per
+ * sector, and when the request is done it wakes only its submitter.
+ * lh_lock protects everything below it.
  */
+struct lhd_request;
+
 struct lhd_softc {
 	/* Initialized by lower-level attach code */
 	void *lh_busdata;		/* The bus we're on */
@@ -51,9 +64,18 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	struct spinlock lh_lock;
+	struct wchan *lh_wchan;		/* callers wait for completion */
+	struct lhd_request *lh_active;	/* request being transferred */
+	struct blkq lh_blkq;		/* waiting requests */
+	uint32_t lh_nextsect;		/* sector after the last one done */
+
+	/* Statistics */
+	struct timespec lh_starttime;
+	unsigned lh_nrequests;		/* requests completed */
+	unsigned lh_ncoalesced;		/* ...that continued the previous one */
+	unsigned lh_nsectors;		/* sectors transferred */
+	unsigned lh_nintrs;		/* completion interrupts */
 
 	struct device lh_dev;		/* VFS device structure */
 };
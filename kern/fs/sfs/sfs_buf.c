@@ -0,0 +1,752 @@
+/*
+ * SFS filesystem
+ *
+ * Buffer cache.
+ *
+ * Disk blocks are cached in a fixed pool of SFS_NBUFS buffers, found
+ * through a hash table keyed by (device, block number). Buffers not
+ * in use by anyone are recycled in least-recently-used order.
+ *
+ * Writes are write-back: sfs_writeblock and friends just mark the
+ * buffer dirty, and the block goes to disk when the buffer is
+ * recycled or when sfs_buf_sync is called from sfs_sync.
+ *
+ * Read-ahead: sfs_buf_prefetch queues a block to be read into the
+ * cache by the sfs_readahead thread, so the read overlaps whatever
+ * the caller does next. A queued block that someone asks for before
+ * the thread gets to it is dropped from the queue, since the caller
+ * is about to read it anyway.
+ *
+ * Synchronization: sfs_buflock protects the hash table, the LRU list,
+ * and every buffer's bookkeeping fields. The lock is not held across
+ * disk I/O; instead the buffer is marked busy, and anyone else who
+ * wants it waits on sfs_bufcv. A buffer's data may be used by anyone
+ * holding a reference and is not itself protected by sfs_buflock;
+ * the callers in SFS rely on the vnode or filesystem they are working
+ * on for that. The read-ahead queue is also protected by sfs_buflock.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <uio.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/* Number of buffers and hash chains. */
+#define SFS_NBUFS	128
+#define SFS_BUFHASH	61
+
+/* Maximum number of blocks waiting to be read ahead. */
+#define SFS_RAQUEUE	64
+
+struct sfs_buf {
+	struct sfs_buf *b_hashnext;	/* hash chain */
+	struct sfs_buf *b_lruprev;	/* LRU list, most recent first */
+	struct sfs_buf *b_lrunext;
+	struct device *b_dev;		/* NULL if the buffer holds nothing */
+	daddr_t b_block;
+	struct sfs_fs *b_fs;		/* for writing back */
+	unsigned b_refcount;		/* references from sfs_buf_get */
+	bool b_valid;			/* b_data holds the block */
+	bool b_dirty;			/* b_data is newer than the disk */
+	bool b_busy;			/* disk I/O in progress */
+	bool b_prefetched;		/* read ahead, not yet used */
+	char b_data[SFS_BLOCKSIZE];
+};
+
+static struct lock *sfs_buflock;
+static struct cv *sfs_bufcv;
+static struct sfs_buf *sfs_bufhash[SFS_BUFHASH];
+static struct sfs_buf *sfs_lruhead, *sfs_lrutail;
+static unsigned sfs_nbufs;
+
+/* Read-ahead queue (a ring) and the cv its thread sleeps on */
+static struct {
+	struct sfs_fs *ra_fs;
+	daddr_t ra_block;
+} sfs_raqueue[SFS_RAQUEUE];
+static unsigned sfs_rahead, sfs_racount;
+static struct cv *sfs_racv;
+static struct sfs_fs *sfs_racurrent;	/* volume being read ahead */
+
+/* Statistics */
+static unsigned sfs_bufhits;
+static unsigned sfs_bufmisses;
+static unsigned sfs_bufreads;
+static unsigned sfs_bufwrites;
+static unsigned sfs_raqueued;
+static unsigned sfs_rareads;
+static unsigned sfs_rahits;
+static unsigned sfs_radropped;
+
+static void sfs_readahead_thread(void *, unsigned long);
+
+/*
+ * Set up the buffer cache and start the read-ahead thread.
+ */
+void
+sfs_bootstrap(void)
+{
+	int result;
+
+	sfs_buflock = lock_create("sfs_buf");
+	if (sfs_buflock == NULL) {
+		panic("sfs: Could not create buffer cache lock\n");
+	}
+	sfs_bufcv = cv_create("sfs_buf");
+	if (sfs_bufcv == NULL) {
+		panic("sfs: Could not create buffer cache cv\n");
+	}
+	sfs_racv = cv_create("sfs_readahead");
+	if (sfs_racv == NULL) {
+		panic("sfs: Could not create read-ahead cv\n");
+	}
+
+	result = thread_fork("sfs_readahead", NULL, sfs_readahead_thread,
+			     NULL, 0);
+	if (result) {
+		panic("sfs: thread_fork: %s\n", strerror(result));
+	}
+}
+
+static
+unsigned
+sfs_buf_hashval(struct device *dev, daddr_t block)
+{
+	return ((uintptr_t)dev / sizeof(void *) + block) % SFS_BUFHASH;
+}
+
+static
+void
+sfs_buf_hashinsert(struct sfs_buf *b)
+{
+	unsigned h = sfs_buf_hashval(b->b_dev, b->b_block);
+
+	b->b_hashnext = sfs_bufhash[h];
+	sfs_bufhash[h] = b;
+}
+
+static
+void
+sfs_buf_hashremove(struct sfs_buf *b)
+{
+	struct sfs_buf **bp;
+
+	bp = &sfs_bufhash[sfs_buf_hashval(b->b_dev, b->b_block)];
+	while (*bp != b) {
+		KASSERT(*bp != NULL);
+		bp = &(*bp)->b_hashnext;
+	}
+	*bp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+struct sfs_buf *
+sfs_buf_lookup(struct device *dev, daddr_t block)
+{
+	struct sfs_buf *b;
+
+	b = sfs_bufhash[sfs_buf_hashval(dev, block)];
+	while (b != NULL) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+		b = b->b_hashnext;
+	}
+	return NULL;
+}
+
+static
+void
+sfs_buf_lruremove(struct sfs_buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		sfs_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		sfs_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+static
+void
+sfs_buf_lruinsert(struct sfs_buf *b, bool front)
+{
+	if (front) {
+		b->b_lruprev = NULL;
+		b->b_lrunext = sfs_lruhead;
+		if (sfs_lruhead != NULL) {
+			sfs_lruhead->b_lruprev = b;
+		}
+		else {
+			sfs_lrutail = b;
+		}
+		sfs_lruhead = b;
+	}
+	else {
+		b->b_lrunext = NULL;
+		b->b_lruprev = sfs_lrutail;
+		if (sfs_lrutail != NULL) {
+			sfs_lrutail->b_lrunext = b;
+		}
+		else {
+			sfs_lruhead = b;
+		}
+		sfs_lrutail = b;
+	}
+}
+
+/*
+ * Transfer a buffer to or from disk. The caller has marked it busy,
+ * and sfs_buflock is dropped for the duration.
+ */
+static
+int
+sfs_buf_io(struct sfs_buf *b, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(lock_do_i_hold(sfs_buflock));
+	KASSERT(b->b_busy);
+
+	if (rw == UIO_READ) {
+		sfs_bufreads++;
+	}
+	else {
+		sfs_bufwrites++;
+	}
+
+	lock_release(sfs_buflock);
+	SFSUIO(&iov, &ku, b->b_data, b->b_block, rw);
+	result = sfs_rwblock(b->b_fs, &ku);
+	lock_acquire(sfs_buflock);
+
+	b->b_busy = false;
+	cv_broadcast(sfs_bufcv, sfs_buflock);
+	return result;
+}
+
+/*
+ * Write back a dirty buffer. The dirty flag is cleared before the
+ * write starts, so a change made while the write is in progress marks
+ * the buffer dirty again.
+ */
+static
+int
+sfs_buf_writeback(struct sfs_buf *b)
+{
+	int result;
+
+	KASSERT(b->b_dirty);
+	KASSERT(!b->b_busy);
+
+	b->b_dirty = false;
+	b->b_busy = true;
+	result = sfs_buf_io(b, UIO_WRITE);
+	if (result) {
+		b->b_dirty = true;
+	}
+	return result;
+}
+
+/*
+ * Drop a reference. A buffer that was never filled in is taken out
+ * of the hash table when the last reference goes, so nobody finds
+ * garbage in it.
+ */
+static
+void
+sfs_buf_unref(struct sfs_buf *b)
+{
+	KASSERT(lock_do_i_hold(sfs_buflock));
+	KASSERT(b->b_refcount > 0);
+
+	b->b_refcount--;
+	if (b->b_refcount > 0) {
+		return;
+	}
+	if (!b->b_valid) {
+		sfs_buf_hashremove(b);
+		b->b_dev = NULL;
+		sfs_buf_lruremove(b);
+		sfs_buf_lruinsert(b, false);
+	}
+	cv_broadcast(sfs_bufcv, sfs_buflock);
+}
+
+/*
+ * Find a buffer to hold a new block: a fresh one if the pool isn't
+ * full yet, otherwise the least recently used one nobody is using.
+ * Returns NULL if none is available right now; in that case
+ * sfs_buflock may have been dropped (to write back a dirty victim)
+ * and the caller should start over.
+ */
+static
+struct sfs_buf *
+sfs_buf_victim(int *err)
+{
+	struct sfs_buf *b;
+
+	*err = 0;
+
+	if (sfs_nbufs < SFS_NBUFS) {
+		b = kmalloc(sizeof(*b));
+		if (b != NULL) {
+			b->b_hashnext = NULL;
+			b->b_dev = NULL;
+			b->b_block = 0;
+			b->b_fs = NULL;
+			b->b_refcount = 0;
+			b->b_valid = false;
+			b->b_dirty = false;
+			b->b_busy = false;
+			b->b_prefetched = false;
+			sfs_buf_lruinsert(b, false);
+			sfs_nbufs++;
+			return b;
+		}
+		if (sfs_nbufs == 0) {
+			*err = ENOMEM;
+			return NULL;
+		}
+	}
+
+	for (b = sfs_lrutail; b != NULL; b = b->b_lruprev) {
+		if (b->b_refcount > 0 || b->b_busy) {
+			continue;
+		}
+		if (b->b_dirty) {
+			*err = sfs_buf_writeback(b);
+			return NULL;
+		}
+		return b;
+	}
+
+	/* Everything is in use; wait for something to be released. */
+	cv_wait(sfs_bufcv, sfs_buflock);
+	return NULL;
+}
+
+/*
+ * Take BLOCK of DEV off the read-ahead queue, if it's there.
+ */
+static
+void
+sfs_buf_racancel(struct device *dev, daddr_t block)
+{
+	unsigned i, j, slot;
+
+	for (i = 0; i < sfs_racount; i++) {
+		slot = (sfs_rahead + i) % SFS_RAQUEUE;
+		if (sfs_raqueue[slot].ra_fs->sfs_device == dev &&
+		    sfs_raqueue[slot].ra_block == block) {
+			/* Close the gap, keeping the rest in order. */
+			for (j = i; j > 0; j--) {
+				sfs_raqueue[(sfs_rahead + j) % SFS_RAQUEUE] =
+				  sfs_raqueue[(sfs_rahead + j - 1) % SFS_RAQUEUE];
+			}
+			sfs_rahead = (sfs_rahead + 1) % SFS_RAQUEUE;
+			sfs_racount--;
+			return;
+		}
+	}
+}
+
+/*
+ * Make victim buffer B hold BLOCK of SFS, not yet read in. Putting it
+ * in the hash table and taking the block off the read-ahead queue are
+ * done together, so the block is always either queued or findable.
+ */
+static
+void
+sfs_buf_assign(struct sfs_buf *b, struct sfs_fs *sfs, daddr_t block)
+{
+	KASSERT(lock_do_i_hold(sfs_buflock));
+	KASSERT(b->b_refcount == 0 && !b->b_busy && !b->b_dirty);
+
+	if (b->b_dev != NULL) {
+		sfs_buf_hashremove(b);
+	}
+	b->b_dev = sfs->sfs_device;
+	b->b_block = block;
+	b->b_fs = sfs;
+	b->b_valid = false;
+	b->b_prefetched = false;
+	sfs_buf_hashinsert(b);
+	sfs_buf_racancel(b->b_dev, block);
+}
+
+/*
+ * Read a referenced buffer's block in from disk.
+ */
+static
+int
+sfs_buf_fill(struct sfs_buf *b)
+{
+	int result;
+
+	KASSERT(b->b_refcount > 0);
+
+	b->b_busy = true;
+	result = sfs_buf_io(b, UIO_READ);
+	if (result) {
+		return result;
+	}
+	b->b_valid = true;
+	return 0;
+}
+
+/*
+ * Guts of sfs_buf_get, called with sfs_buflock held. It's held again
+ * on return, whether or not there was an error.
+ */
+static
+int
+sfs_buf_getlocked(struct sfs_fs *sfs, daddr_t block, bool fill,
+		  struct sfs_buf **ret)
+{
+	struct device *dev = sfs->sfs_device;
+	struct sfs_buf *b;
+	int result;
+
+	KASSERT(dev != NULL);
+	KASSERT(lock_do_i_hold(sfs_buflock));
+
+	while (1) {
+		b = sfs_buf_lookup(dev, block);
+		if (b != NULL) {
+			/*
+			 * Wait out I/O, and anyone who got the buffer
+			 * without FILL and hasn't filled it in yet.
+			 */
+			if (b->b_busy || (!b->b_valid && b->b_refcount > 0)) {
+				cv_wait(sfs_bufcv, sfs_buflock);
+				continue;
+			}
+			sfs_bufhits++;
+			if (b->b_prefetched) {
+				sfs_rahits++;
+				b->b_prefetched = false;
+			}
+			break;
+		}
+
+		b = sfs_buf_victim(&result);
+		if (result) {
+			return result;
+		}
+		if (b == NULL) {
+			continue;
+		}
+		sfs_buf_assign(b, sfs, block);
+		sfs_bufmisses++;
+		break;
+	}
+
+	b->b_fs = sfs;
+	b->b_refcount++;
+	sfs_buf_lruremove(b);
+	sfs_buf_lruinsert(b, true);
+
+	if (fill && !b->b_valid) {
+		result = sfs_buf_fill(b);
+		if (result) {
+			sfs_buf_unref(b);
+			return result;
+		}
+	}
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Get a referenced buffer for BLOCK on SFS's device. If FILL is set
+ * the buffer's contents are read from disk if not already cached;
+ * otherwise the caller is going to overwrite the whole block.
+ */
+int
+sfs_buf_get(struct sfs_fs *sfs, daddr_t block, bool fill,
+	    struct sfs_buf **ret)
+{
+	int result;
+
+	lock_acquire(sfs_buflock);
+	result = sfs_buf_getlocked(sfs, block, fill, ret);
+	lock_release(sfs_buflock);
+	return result;
+}
+
+/*
+ * Get a referenced buffer for BLOCK only if it is already cached.
+ */
+struct sfs_buf *
+sfs_buf_peek(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_buf *b;
+
+	lock_acquire(sfs_buflock);
+	while (1) {
+		b = sfs_buf_lookup(sfs->sfs_device, block);
+		if (b == NULL || !b->b_busy) {
+			break;
+		}
+		cv_wait(sfs_bufcv, sfs_buflock);
+	}
+	if (b != NULL && b->b_valid) {
+		b->b_refcount++;
+		sfs_buf_lruremove(b);
+		sfs_buf_lruinsert(b, true);
+		if (b->b_prefetched) {
+			sfs_rahits++;
+			b->b_prefetched = false;
+		}
+	}
+	else {
+		/* The caller will read it directly; don't read it twice. */
+		sfs_buf_racancel(sfs->sfs_device, block);
+		b = NULL;
+	}
+	lock_release(sfs_buflock);
+	return b;
+}
+
+/*
+ * Queue BLOCK to be read into the cache in the background. This is
+ * only a hint: it is dropped if the block is already cached or the
+ * queue is full.
+ */
+void
+sfs_buf_prefetch(struct sfs_fs *sfs, daddr_t block)
+{
+	unsigned i, slot;
+
+	lock_acquire(sfs_buflock);
+	if (sfs_buf_lookup(sfs->sfs_device, block) != NULL) {
+		lock_release(sfs_buflock);
+		return;
+	}
+	for (i = 0; i < sfs_racount; i++) {
+		slot = (sfs_rahead + i) % SFS_RAQUEUE;
+		if (sfs_raqueue[slot].ra_fs == sfs &&
+		    sfs_raqueue[slot].ra_block == block) {
+			lock_release(sfs_buflock);
+			return;
+		}
+	}
+	if (sfs_racount == SFS_RAQUEUE) {
+		sfs_radropped++;
+		lock_release(sfs_buflock);
+		return;
+	}
+	slot = (sfs_rahead + sfs_racount) % SFS_RAQUEUE;
+	sfs_raqueue[slot].ra_fs = sfs;
+	sfs_raqueue[slot].ra_block = block;
+	sfs_racount++;
+	sfs_raqueued++;
+	cv_signal(sfs_racv, sfs_buflock);
+	lock_release(sfs_buflock);
+}
+
+/*
+ * Read-ahead thread. Reads the block at the head of the queue into
+ * the cache, leaving it queued until its buffer is in the hash table
+ * (see sfs_buf_assign); otherwise, while sfs_buflock is dropped to
+ * find a victim, a writer could miss it in both places and write the
+ * disk directly, and the read could then cache the old contents.
+ * Whenever the lock has been dropped, start over from the queue.
+ */
+static
+void
+sfs_readahead_thread(void *unused1, unsigned long unused2)
+{
+	struct sfs_fs *sfs;
+	struct sfs_buf *b;
+	struct device *dev;
+	daddr_t block;
+	int result;
+
+	(void)unused1;
+	(void)unused2;
+
+	lock_acquire(sfs_buflock);
+	while (1) {
+		while (sfs_racount == 0) {
+			cv_wait(sfs_racv, sfs_buflock);
+		}
+		sfs = sfs_raqueue[sfs_rahead].ra_fs;
+		block = sfs_raqueue[sfs_rahead].ra_block;
+		dev = sfs->sfs_device;
+
+		if (sfs_buf_lookup(dev, block) != NULL) {
+			sfs_buf_racancel(dev, block);
+			continue;
+		}
+		b = sfs_buf_victim(&result);
+		if (b == NULL) {
+			if (result) {
+				/* No room for it; forget it. */
+				sfs_buf_racancel(dev, block);
+				sfs_radropped++;
+			}
+			continue;
+		}
+
+		sfs_rareads++;
+		sfs_racurrent = sfs;
+		sfs_buf_assign(b, sfs, block);
+		b->b_refcount++;
+		sfs_buf_lruremove(b);
+		sfs_buf_lruinsert(b, true);
+		result = sfs_buf_fill(b);
+		if (result == 0) {
+			b->b_prefetched = true;
+		}
+		sfs_buf_unref(b);
+		sfs_racurrent = NULL;
+		cv_broadcast(sfs_bufcv, sfs_buflock);
+	}
+}
+
+void *
+sfs_buf_data(struct sfs_buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+	return b->b_data;
+}
+
+/*
+ * Note that the caller has changed the buffer's contents. This also
+ * makes a buffer gotten without FILL valid.
+ */
+void
+sfs_buf_markdirty(struct sfs_buf *b)
+{
+	lock_acquire(sfs_buflock);
+	KASSERT(b->b_refcount > 0);
+	b->b_valid = true;
+	b->b_dirty = true;
+	lock_release(sfs_buflock);
+}
+
+void
+sfs_buf_release(struct sfs_buf *b)
+{
+	lock_acquire(sfs_buflock);
+	sfs_buf_unref(b);
+	lock_release(sfs_buflock);
+}
+
+/*
+ * Write back every dirty buffer belonging to SFS.
+ */
+int
+sfs_buf_sync(struct sfs_fs *sfs)
+{
+	struct sfs_buf *b;
+	int result;
+
+	lock_acquire(sfs_buflock);
+ again:
+	for (b = sfs_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dev != sfs->sfs_device || !b->b_dirty) {
+			continue;
+		}
+		if (b->b_busy) {
+			cv_wait(sfs_bufcv, sfs_buflock);
+			goto again;
+		}
+		/* The list can change while the lock is dropped. */
+		result = sfs_buf_writeback(b);
+		if (result) {
+			lock_release(sfs_buflock);
+			return result;
+		}
+		goto again;
+	}
+	lock_release(sfs_buflock);
+	return 0;
+}
+
+/*
+ * Forget every buffer belonging to SFS. Used at unmount, after
+ * sfs_buf_sync, and when a mount fails partway. Pending read-ahead
+ * for the volume is cancelled and any in progress is waited out.
+ */
+void
+sfs_buf_invalidate(struct sfs_fs *sfs)
+{
+	struct sfs_buf *b, *next;
+	unsigned i, slot;
+
+	lock_acquire(sfs_buflock);
+ again:
+	for (i = 0; i < sfs_racount; i++) {
+		slot = (sfs_rahead + i) % SFS_RAQUEUE;
+		if (sfs_raqueue[slot].ra_fs == sfs) {
+			sfs_buf_racancel(sfs->sfs_device,
+					 sfs_raqueue[slot].ra_block);
+			goto again;
+		}
+	}
+	if (sfs_racurrent == sfs) {
+		cv_wait(sfs_bufcv, sfs_buflock);
+		goto again;
+	}
+
+	for (b = sfs_lruhead; b != NULL; b = next) {
+		next = b->b_lrunext;
+		if (b->b_dev != sfs->sfs_device) {
+			continue;
+		}
+		KASSERT(b->b_refcount == 0);
+		KASSERT(!b->b_busy);
+		KASSERT(!b->b_dirty);
+		sfs_buf_hashremove(b);
+		b->b_dev = NULL;
+		b->b_fs = NULL;
+		b->b_valid = false;
+		sfs_buf_lruremove(b);
+		sfs_buf_lruinsert(b, false);
+	}
+	lock_release(sfs_buflock);
+}
+
+/*
+ * Print buffer cache statistics.
+ */
+void
+sfs_printstats(void)
+{
+	struct sfs_buf *b;
+	unsigned used = 0, dirty = 0;
+
+	lock_acquire(sfs_buflock);
+	for (b = sfs_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dev != NULL) {
+			used++;
+		}
+		if (b->b_dirty) {
+			dirty++;
+		}
+	}
+	kprintf("sfs buffer cache: %u/%u buffers in use, %u dirty\n",
+		used, SFS_NBUFS, dirty);
+	kprintf("    %u hits, %u misses, %u reads, %u writes\n",
+		sfs_bufhits, sfs_bufmisses, sfs_bufreads, sfs_bufwrites);
+	kprintf("    read-ahead: %u queued, %u read, %u used, %u dropped\n",
+		sfs_raqueued, sfs_rareads, sfs_rahits, sfs_radropped);
+	lock_release(sfs_buflock);
+}
@@ -52,6 +52,18 @@ int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		daddr_t *diskblock);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
 
+/* Functions in sfs_buf.c */
+struct sfs_buf;
+int sfs_buf_get(struct sfs_fs *sfs, daddr_t block, bool fill,
+		struct sfs_buf **ret);
+struct sfs_buf *sfs_buf_peek(struct sfs_fs *sfs, daddr_t block);
+void *sfs_buf_data(struct sfs_buf *buf);
+void sfs_buf_markdirty(struct sfs_buf *buf);
+void sfs_buf_release(struct sfs_buf *buf);
+void sfs_buf_prefetch(struct sfs_fs *sfs, daddr_t block);
+int sfs_buf_sync(struct sfs_fs *sfs);
+void sfs_buf_invalidate(struct sfs_fs *sfs);
+
 /* Functions in sfs_dir.c */
 int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot);
@@ -71,6 +83,7 @@ int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
 
 /* Functions in sfs_io.c */
+int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_io(struct sfs_vnode *sv, struct uio *uio);
@@ -39,6 +39,7 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct lock;
 #define STACKPAGES 18
 
 
@@ -54,15 +55,56 @@ struct regions {
   size_t npages;
   //permissions: READ WRITE EXEC. In that order
   bool permissions[3];
+  //File backing for program segments: FILESZ bytes at file offset
+  //FILEOFFSET appear at FILEVADDR; the rest of the region is zeros
+  struct vnode *vn;
+  vaddr_t filevaddr;
+  off_t fileoffset;
+  size_t filesz;
+  int flags;			/* REG_* */
   struct regions *next;
 };
 
-struct pagetable_entry{
-  int vaddr:20;
-  int paddr:20;
-  bool permissions[3];
-  struct pagetable_entry *next;
-};
+#define REG_MMAP	0x1	/* made by mmap; munmap may take it away */
+#define REG_SHARED	0x2	/* stores go back to the file, not to swap */
+
+/*
+ * Page table.
+ *
+ * Two levels, matching the MIPS 4K page: the top 10 bits of a
+ * virtual address index a 1024-entry directory of leaf pointers, and
+ * the next 10 bits index a 1024-entry leaf page of PTEs. Leaves are
+ * allocated on first use, so a sparse address space costs one page
+ * per 4M actually touched.
+ *
+ * A PTE is one word: the physical frame in the top 20 bits (the same
+ * place TLBLO keeps it) and flag bits below.
+ *
+ * as_copy shares frames between parent and child instead of copying
+ * them, and marks writeable pages PTE_COW in both. Such pages go in
+ * the TLB read-only; the first write copies the frame (or, if the
+ * other side has already let go of it, just takes it over).
+ *
+ * A page that has been paged out has PTE_SWAPPED instead of
+ * PTE_VALID, and its swap address where the frame would be.
+ *
+ * as_lock protects the page table. It is taken by vm_fault and
+ * as_copy in the owning process, and by the pageout code when it
+ * takes a frame away.
+ */
+#define PT_NENTRIES	1024
+#define PT_DIRINDEX(va)	(((va) >> 22) & 0x3ff)
+#define PT_LEAFINDEX(va) (((va) >> 12) & 0x3ff)
+
+#define PTE_FRAME	0xfffff000	/* physical frame address */
+#define PTE_VALID	0x00000001	/* frame is resident */
+#define PTE_DIRTY	0x00000002	/* page has been written */
+#define PTE_READ	0x00000004
+#define PTE_WRITE	0x00000008
+#define PTE_EXEC	0x00000010
+#define PTE_COW		0x00000020	/* frame shared since fork */
+#define PTE_SWAPPED	0x00000040	/* page is in swap */
+#define PTE_PERMS	(PTE_READ | PTE_WRITE | PTE_EXEC)
 
 struct addrspace {
 #if OPT_DUMBVM
@@ -74,7 +116,8 @@ struct addrspace {
         size_t as_npages2;
         paddr_t as_stackpbase;
 #else        
-        struct pagetable_entry *pages;
+        uint32_t **pagetable;		/* directory of leaf pages */
+        struct lock *as_lock;		/* protects pagetable */
         struct regions *regionlist;
         vaddr_t heap_start;
         vaddr_t heap_end;
@@ -91,9 +134,9 @@ struct addrspace {
  *                return NULL on out-of-memory error.
  *
  *    as_copy   - create a new address space that is an exact copy of
- *                an old one. Probably calls as_create to get a new
- *                empty address space and fill it in, but that's up to
- *                you.
+ *                an old one. Resident frames are shared copy-on-write
+ *                rather than copied, so this costs time in the size
+ *                of the page table, not of the memory mapped.
  *
  *    as_activate - make curproc's address space the one currently
  *                "seen" by the processor.
@@ -115,10 +158,32 @@ struct addrspace {
  *    as_complete_load - this is called when loading from an executable
  *                is complete.
  *
+ *    as_define_filedata - back the region containing VADDR with FILESZ
+ *                bytes of vnode VN starting at OFFSET, to be read in a
+ *                page at a time as the pages are first touched. The
+ *                address space holds a reference to VN.
+ *
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_mmap   - add a mapping of NPAGES pages, with PROT_* permissions
+ *                PROT and REG_SHARED if set in FLAGS, somewhere between
+ *                the heap and the stack, and return its address in
+ *                RET. If VN isn't NULL the first FILESZ bytes are backed
+ *                by VN from OFFSET on, and the rest are zeros.
+ *
+ *    as_munmap - remove NPAGES pages at VADDR, which must all be in one
+ *                mapping made by as_mmap, writing dirty pages of a
+ *                shared mapping back first.
+ *
+ *    as_sync   - write back every dirty page of the shared mappings of
+ *                VN, or of all files if VN is NULL.
+ *
+ *    as_overlaps - whether any region intersects the NPAGES pages at
+ *                VADDR, so that sbrk doesn't grow the heap into a
+ *                mapping.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -134,11 +199,63 @@ int               as_define_region(struct addrspace *as,
                                    int readable,
                                    int writeable,
                                    int executable);
+int               as_define_filedata(struct addrspace *as,
+                                     vaddr_t vaddr, size_t filesz,
+                                     struct vnode *vn, off_t offset);
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
-struct pagetable_entry * get_pte(struct addrspace *as, vaddr_t vbase);
-void pte_insert(struct addrspace *as, vaddr_t vbase, vaddr_t pbase, bool perm[3]);
+int               as_mmap(struct addrspace *as, size_t npages, int prot,
+                          int flags, struct vnode *vn, off_t offset,
+                          size_t filesz, vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t vaddr,
+                            size_t npages);
+int               as_sync(struct addrspace *as, struct vnode *vn);
+bool              as_overlaps(struct addrspace *as, vaddr_t vaddr,
+                              size_t npages);
+
+/*
+ * Page table and region helpers, also in addrspace.c:
+ *
+ *    as_perms  - PTE permission bits for VADDR, from the region,
+ *                heap or stack containing it; 0 if unmapped.
+ *
+ *    get_pte   - return the PTE slot for VADDR, or NULL if its leaf
+ *                has never been allocated.
+ *
+ *    pte_insert - map VADDR to physical frame PADDR with FLAGS,
+ *                allocating the leaf if needed. Returns ENOMEM if
+ *                it can't.
+ *
+ *    as_fill_page - set up the initial contents of the page at VADDR
+ *                in frame PADDR: zeros, plus whatever part of it is
+ *                backed by the executable. Reads the file, so must be
+ *                called without as_lock; only by the process's own
+ *                thread.
+ *
+ *    as_textvnode - the executable whose read-only text the page at
+ *                VADDR is, so that it can be shared through the text
+ *                cache; NULL if it's private.
+ *
+ *    as_sharedfile - whether the page at VADDR is in a shared file
+ *                mapping, and so is paged out to the file instead of
+ *                to swap. Call with as_lock held.
+ *
+ *    as_writeback - write the part of frame PADDR that is backed by
+ *                the shared file mapping at VADDR back to the file.
+ *                Call with as_lock held; it is released for the write
+ *                and not taken again. The frame must be pinned.
+ */
+uint32_t          as_perms(struct addrspace *as, vaddr_t vaddr);
+uint32_t         *get_pte(struct addrspace *as, vaddr_t vaddr);
+int               pte_insert(struct addrspace *as, vaddr_t vaddr,
+                             paddr_t paddr, uint32_t flags);
+int               as_fill_page(struct addrspace *as, vaddr_t vaddr,
+                               paddr_t paddr);
+struct vnode     *as_textvnode(struct addrspace *as, vaddr_t vaddr);
+bool              as_sharedfile(struct addrspace *as, vaddr_t vaddr);
+int               as_writeback(struct addrspace *as, vaddr_t vaddr,
+                               paddr_t paddr);
 
 /*
  * Functions in loadelf.c
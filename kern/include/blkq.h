@@ -0,0 +1,75 @@
+#ifndef _BLKQ_H_
+#define _BLKQ_H_
+
+/*
+ * Block request queue.
+ *
+ * A block device driver keeps its waiting requests in a struct blkq
+ * and asks it which to start next; the queue's policy decides. The
+ * policies are:
+ *
+ *    fifo     - arrival order, except that a request starting where
+ *               the last transfer ended goes first.
+ *    clook    - C-LOOK elevator: requests are served in increasing
+ *               block order from the head position, then the head
+ *               sweeps back to the lowest waiting block.
+ *    deadline - C-LOOK, but any request that has waited longer than
+ *               its deadline (BLKQ_READ_DEADLINE ms for reads,
+ *               BLKQ_WRITE_DEADLINE ms for writes) is served first,
+ *               oldest deadline first. This bounds read latency.
+ *
+ * The queue has no lock of its own; the driver calls these with its
+ * own spinlock held, including from its interrupt handler.
+ *
+ *    blkq_init      - set up an empty queue using the default policy.
+ *    blkq_setpolicy - switch policy by name, keeping waiting requests.
+ *                     Returns EINVAL for an unknown name.
+ *    blkq_add       - queue a request.
+ *    blkq_next      - remove and return the request to start next,
+ *                     given the block after the last one transferred;
+ *                     NULL if the queue is empty.
+ *    blkq_done      - record that a request has completed.
+ *    blkq_printstats - print the policy and the queue-depth and
+ *                     latency histograms.
+ */
+
+#include <kern/time.h>
+
+#define BLKQ_DEFAULT_POLICY	"clook"
+#define BLKQ_READ_DEADLINE	50	/* ms */
+#define BLKQ_WRITE_DEADLINE	500	/* ms */
+
+/* Histogram buckets: [0], [1], [2,3], [4,7], ... and the rest. */
+#define BLKQ_NBUCKETS		12
+
+struct blkq_req {
+	struct blkq_req *br_next;
+	uint32_t br_block;		/* first block */
+	bool br_write;
+	struct timespec br_queued;	/* when blkq_add saw it */
+	struct timespec br_deadline;
+};
+
+struct blkq_policy;
+
+struct blkq {
+	const struct blkq_policy *bq_policy;
+	struct blkq_req *bq_reqs;	/* waiting requests */
+	unsigned bq_depth;		/* how many */
+
+	/* Statistics */
+	unsigned bq_depthhist[BLKQ_NBUCKETS];	/* depth seen on arrival */
+	unsigned bq_lathist[BLKQ_NBUCKETS];	/* ms from add to done */
+	unsigned bq_nexpired;		/* served early by deadline */
+};
+
+void blkq_init(struct blkq *bq);
+int blkq_setpolicy(struct blkq *bq, const char *name);
+void blkq_add(struct blkq *bq, struct blkq_req *br, uint32_t block,
+	      bool write);
+struct blkq_req *blkq_next(struct blkq *bq, uint32_t headpos);
+void blkq_done(struct blkq *bq, struct blkq_req *br);
+void blkq_printstats(struct blkq *bq);
+
+
+#endif /* _BLKQ_H_ */
@@ -40,13 +40,27 @@
 /*
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
+ *
+ * It is really called on every timer interrupt, which the machine
+ * dependent code has to let us program: each CPU's next interrupt is
+ * set for its next tick or its next timeout (see <timer.h>), whichever
+ * is sooner. Idle CPUs take no ticks at all, only timeouts.
+ *
+ * hardclock_start() is called on each CPU once the real-time clock is
+ * available; until then hardclock() just ticks. hardclock_reprogram()
+ * sets the next timer interrupt, after timeouts were added or when a
+ * CPU goes idle; hardclock_unidle() restarts the ticks when it stops
+ * being idle.
  */
 
 /* hardclocks per second */
 #define HZ  100
 
 void hardclock_bootstrap(void);
+void hardclock_start(void);
 void hardclock(void);
+void hardclock_reprogram(void);
+void hardclock_unidle(void);
 
 /*
  * timerclock() is called on one CPU once a second to allow simple
@@ -59,6 +73,12 @@ void timerclock(void);
  */
 void gettime(struct timespec *ret);
 
+/*
+ * gettime_nsecs() returns the current time as a count of nanoseconds,
+ * which is handier for timeouts.
+ */
+uint64_t gettime_nsecs(void);
+
 /*
  * arithmetic on times
  *
@@ -79,5 +99,10 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * clocksleep_nsecs() is the same with nanosecond resolution.
+ */
+void clocksleep_nsecs(uint64_t nsecs);
+
 
 #endif /* _CLOCK_H_ */
@@ -33,10 +33,14 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <timer.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 extern unsigned num_cpus;
 
+/* Number of free pages each cpu may hold in its page cache. */
+#define CPU_PAGECACHE_MAX 32
+
 /*
  * Per-cpu structure
  *
@@ -60,7 +64,8 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
-	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_hardclocks;		/* Counter of hardclock() ticks */
+	uint64_t c_nexttick;		/* When the next one is due, or 0 */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -71,6 +76,33 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Copy of c_runqueue.tl_count, set with the runqueue lock
+	 * held. Other cpus read it without the lock to decide where
+	 * to put or take threads, so it's only a hint.
+	 */
+	volatile unsigned c_runqueue_len;
+
+	/*
+	 * Timeouts to run on this cpu. Accessed by other cpus only to
+	 * cancel them. Protected by the lock inside.
+	 */
+	struct timerwheel c_timers;
+
+	/*
+	 * Cache of free physical pages in front of the coremap.
+	 * Normally touched only by this cpu, but other cpus may
+	 * drain it when memory runs short.
+	 * Protected by the page cache lock.
+	 */
+	unsigned c_npagecache;		/* Pages in c_pagecache */
+	paddr_t c_pagecache[CPU_PAGECACHE_MAX];
+	unsigned c_pagecache_hits;	/* Allocs served from the cache */
+	unsigned c_pagecache_misses;	/* Allocs that found it empty */
+	unsigned c_pagecache_refills;	/* Batches taken from coremap */
+	unsigned c_pagecache_drains;	/* Batches returned to coremap */
+	struct spinlock c_pagecache_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -101,12 +133,16 @@ struct cpu {
  *
  * cpu_create calls cpu_machdep_init.
  *
+ * cpu_get returns the cpu with software number INDEX, or NULL if
+ * there is no such cpu.
+ *
  * cpu_start_secondary is the platform-dependent assembly language
  * entry point for new CPUs; it can be found in start.S. It calls
  * cpu_hatch after having claimed the startup stack and thread created
  * for the cpu.
  */
 struct cpu *cpu_create(unsigned hardware_number);
+struct cpu *cpu_get(unsigned index);
 void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
@@ -56,11 +56,16 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_printstats - print usage statistics (optional; may be NULL)
+ *      devop_setsched - select the I/O scheduler by name, for block
+ *              devices that queue requests (optional; may be NULL)
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	void (*devop_printstats)(struct device *);
+	int (*devop_setsched)(struct device *, const char *name);
 };
 
 /*
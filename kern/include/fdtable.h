@@ -0,0 +1,101 @@
+#ifndef _FDTABLE_H_
+#define _FDTABLE_H_
+
+/*
+ * Open file handles and per-process file descriptor tables.
+ *
+ * A file_handle is one open of a file: the vnode, the open flags, and
+ * the seek offset (protected by filelock). Handles are reference
+ * counted. Every descriptor slot that points to a handle holds a
+ * reference, as does anyone using it via fdtable_get. Descriptors
+ * copied by fork or dup2 share the handle, and thus the offset.
+ *
+ * An fdtable maps descriptors to handles for one process. It starts
+ * with FDTABLE_MINSIZE slots and doubles when full, up to OPEN_MAX.
+ * A bitmap of used slots plus a hint of where the lowest free slot
+ * might be make finding the lowest free descriptor cheap.
+ *
+ * Lookups take no table lock, so threads of one process doing I/O
+ * don't serialize on the table:
+ *
+ *   - The slot array is never resized in place. Growing the table
+ *     publishes a new copy, and old copies are kept until the table is
+ *     destroyed, so a reader holding a stale array pointer still reads
+ *     valid memory.
+ *
+ *   - Handles are never returned to kmalloc; freed ones go on a free
+ *     list for reuse. A reader can therefore always lock a handle it
+ *     found in a slot, take a reference if the count isn't zero, and
+ *     then check that the slot still points there, retrying if not.
+ *
+ * Changes to a table (add, remove, dup2, growth) are serialized by
+ * ft_lock.
+ *
+ * Functions:
+ *
+ *    fh_create       - make a handle for an opened vnode, with one
+ *                      reference. The handle owns the vnode from then
+ *                      on and closes it when the last reference goes.
+ *    fh_incref       - add a reference.
+ *    fh_decref       - drop a reference.
+ *
+ *    fdtable_create  - make an empty table.
+ *    fdtable_copy    - make a table with the same descriptors, sharing
+ *                      the handles (for fork).
+ *    fdtable_destroy - close every descriptor and free the table.
+ *    fdtable_add     - install a handle at the lowest free descriptor,
+ *                      taking over the caller's reference. Returns
+ *                      EMFILE if the table is full.
+ *    fdtable_get     - look up a descriptor and return its handle with
+ *                      a new reference, which the caller must drop with
+ *                      fh_decref. Returns EBADF if it isn't open.
+ *    fdtable_remove  - close a descriptor.
+ *    fdtable_dup2    - make NEWFD refer to OLDFD's handle, closing
+ *                      whatever NEWFD referred to before.
+ */
+
+#include <spinlock.h>
+
+struct lock;
+struct vnode;
+
+#define FDTABLE_MINSIZE 16
+
+struct file_handle {
+	int flags;
+	off_t offset;			/* protected by filelock */
+	int ref_count;			/* protected by ref_lock */
+	struct spinlock ref_lock;
+	struct lock *filelock;
+	struct vnode *vnode;
+	struct file_handle *next_free;	/* on the free list */
+};
+
+struct fdarray {
+	unsigned fa_size;		/* number of slots */
+	struct file_handle **fa_slots;
+	uint32_t *fa_used;		/* bitmap of slots in use */
+	struct fdarray *fa_older;	/* retired smaller copies */
+};
+
+struct fdtable {
+	struct lock *ft_lock;
+	struct fdarray *volatile ft_array;
+	unsigned ft_lowfree;		/* no free slot below this */
+};
+
+int fh_create(struct vnode *vn, int flags, off_t offset,
+	      struct file_handle **ret);
+void fh_incref(struct file_handle *fh);
+void fh_decref(struct file_handle *fh);
+
+struct fdtable *fdtable_create(void);
+int fdtable_copy(struct fdtable *old, struct fdtable **ret);
+void fdtable_destroy(struct fdtable *ft);
+int fdtable_add(struct fdtable *ft, struct file_handle *fh, int *fd);
+int fdtable_get(struct fdtable *ft, int fd, struct file_handle **ret);
+int fdtable_remove(struct fdtable *ft, int fd);
+int fdtable_dup2(struct fdtable *ft, int oldfd, int newfd);
+
+
+#endif /* _FDTABLE_H_ */
@@ -0,0 +1,73 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics (options lockstat).
+ *
+ * Spinlocks, sleep locks and CVs report each acquisition here, keyed
+ * by the kind of lock, its name (spinlocks have none), and the
+ * acquisition site, that is, the return address of the call to
+ * spinlock_acquire, lock_acquire or cv_wait. For each key we count
+ * acquisitions and contended acquisitions (ones that found the lock
+ * held and had to spin or sleep), total and maximum time spent
+ * waiting, and total time held. For CVs every wait counts as
+ * contended, the wait time is the time asleep, and there's no hold
+ * time.
+ *
+ * Times are in nanoseconds from gettime_nsecs(): the ltimer clock is
+ * cycle-accurate, while the on-chip cycle counter is reset by every
+ * timer interrupt and can't time anything that spans one.
+ *
+ * Nothing is recorded until lockstat_bootstrap has been called, which
+ * has to wait for the clock device to be attached. Without options
+ * lockstat, none of this is compiled and the lock code has no hooks.
+ *
+ *    lockstat_now      - current time for the hooks, or 0 if not
+ *                        recording yet.
+ *
+ *    lockstat_acquired - count an acquisition of a KIND lock called
+ *                        NAME (NULL for spinlocks) at SITE that started
+ *                        waiting at START (from lockstat_now) and got it
+ *                        at NOW. Returns the record, for lockstat_released,
+ *                        or NULL if not recording.
+ *
+ *    lockstat_released - add NOW - HOLDSTART to LS's hold time, where
+ *                        HOLDSTART is the NOW given to lockstat_acquired.
+ *                        LS may be NULL.
+ *
+ *    lockstat_dump     - print the N records with the most wait time.
+ *
+ *    lockstat_reset    - zero all the counts.
+ *
+ * Must be callable with spinlocks held and from interrupt handlers, so
+ * the table is protected without using spinlocks of its own: each
+ * record has its own lock word, and new records are published so
+ * lookups don't need any lock.
+ */
+
+#include "opt-lockstat.h"
+
+#define LOCKSTAT_SPINLOCK	0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_CV		2
+
+#if OPT_LOCKSTAT
+
+struct lockstat;
+
+void lockstat_bootstrap(void);
+
+uint64_t lockstat_now(void);
+struct lockstat *lockstat_acquired(unsigned kind, const char *name,
+				   const void *site, bool contended,
+				   uint64_t start, uint64_t now);
+void lockstat_released(struct lockstat *ls, uint64_t holdstart,
+		       uint64_t now);
+
+void lockstat_dump(unsigned n);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,12 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Make the current cpu's next timer interrupt come NSECS from now,
+ * as closely as the hardware can. (Interrupts should be off.)
+ */
+void mainbus_settimer(uint64_t nsecs);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
@@ -30,7 +30,13 @@
 #ifndef _PROC_H_
 #define _PROC_H_
 #define INVALID_PID	0
-#define MAX_PROC 256
+
+/*
+ * PIDs run from PID_MIN to PROC_MAXPID. Live processes are found by
+ * PID in a hash table of PROC_HASHSIZE chains.
+ */
+#define PROC_MAXPID	PID_MAX
+#define PROC_HASHSIZE	256
 
 /*
  * Definition of a process.
@@ -43,6 +49,17 @@
 struct addrspace;
 struct thread;
 struct vnode;
+struct fdtable;
+struct cv;
+
+/*
+ * A doubly-linked list of processes, threaded through p_sibprev and
+ * p_sibnext.
+ */
+struct proclist {
+	struct proc *pl_head;
+	struct proc *pl_tail;
+};
 
 /*
  * Process structure.
@@ -71,14 +88,23 @@ struct proc {
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
+	struct fdtable *p_fdtable;	/* open file descriptors */
 
 	/* add more material here as needed */
 	pid_t pid;
 	pid_t ppid;
 	bool exited;
 	int exitcode;
-	struct semaphore* exitsem;
 	struct thread* self;
+	struct proc *p_hashnext;	/* PID hash chain */
+
+	/* Family; all protected by proc_lock */
+	struct proc *p_parent;		/* NULL once the parent exits */
+	struct proclist p_children;	/* running children */
+	struct proclist p_zombies;	/* exited children, in exit order */
+	struct proc *p_sibprev;		/* links on the parent's lists */
+	struct proc *p_sibnext;
+	struct cv *p_waitcv;		/* signalled when a child exits */
 };
 // } *myStruct[512];
 
@@ -89,7 +115,6 @@ struct proc {
 //};
 extern struct lock* proc_lock;
 
-struct proc *proc_table[MAX_PROC];
 
 // struct pidinfo{
 // 	pid_t pid;
@@ -131,10 +156,25 @@ struct addrspace *proc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *proc_setas(struct addrspace *);
 
-/* Process ID Allocation */
-pid_t pid_alloc(void);
-pid_t givepid(void);
-void remove_pid(pid_t pid);
+/* Find the process with a given PID, or NULL. */
+struct proc *proc_lookup(pid_t pid);
+
+/*
+ * Parent/child bookkeeping for exit and waitpid, under proc_lock:
+ *
+ *    proc_addchild  - make CHILD a child of PARENT.
+ *    proc_remchild  - undo proc_addchild for a child that never ran.
+ *    proc_exited    - record that PROC has exited with STATUS: orphan
+ *                     its running children, free its zombies, and move
+ *                     it to its parent's zombie list (or free it if it
+ *                     has no parent). PROC must have no threads left.
+ *    proc_reap      - take an exited child off its parent's zombie
+ *                     list, free it, and release its PID.
+ */
+void proc_addchild(struct proc *parent, struct proc *child);
+void proc_remchild(struct proc *child);
+void proc_exited(struct proc *proc, int status);
+void proc_reap(struct proc *proc);
 struct proc * proc_create(const char *name);
 
 void entrypoint(void* data1, unsigned long data2);
@@ -142,7 +182,6 @@ void entrypoint(void* data1, unsigned long data2);
 // pid_t sys_fork(struct trapframe *tf, int *retval);
 // int pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret);
 void sys_exit(int exitcode);
-void destroy_process(pid_t pid);
 pid_t sys_waitpid(pid_t pid, int *status, int options, int *retval, bool is_kernel);
 int copyout(const void *src, userptr_t userdest, size_t len);
 
@@ -56,6 +56,11 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+
+	/* Read-ahead state (see sfs_io.c) */
+	off_t sv_rapos;                 /* where the last read ended */
+	uint32_t sv_rawindow;           /* blocks to keep read ahead */
+	uint32_t sv_ranext;             /* first block not yet queued */
 };
 
 /*
@@ -76,5 +81,11 @@ struct sfs_fs {
  */
 int sfs_mount(const char *device);
 
+/*
+ * Buffer cache setup (at boot) and statistics.
+ */
+void sfs_bootstrap(void);
+void sfs_printstats(void);
+
 
 #endif /* _SFS_H_ */
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
  #include <types.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -46,6 +47,8 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+struct lockstat;	/* from <lockstat.h> */
+
 /*
  * Basic spinlock.
  *
@@ -58,12 +61,20 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	struct lockstat *splk_stat;	    /* Record of current acquisition. */
+	uint64_t splk_acqtime;		    /* When it was acquired. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
+#if OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0 }
+#else
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
@@ -0,0 +1,50 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space.
+ *
+ * Pages are paged out to a raw disk (SWAP_DEVICE) in page-sized
+ * slots. A swap address is the byte offset of a slot on the device,
+ * so it is page-aligned and fits in the frame bits of a PTE. Slot 0
+ * is never handed out, which leaves 0 free to mean "no swap copy".
+ *
+ *    swap_bootstrap - open the swap device and size the slot bitmap.
+ *                     If the device is missing the system runs
+ *                     without swap and swap_alloc always fails.
+ *
+ *    swap_alloc     - reserve a free slot. Returns ENOSPC if swap is
+ *                     full or absent.
+ *
+ *    swap_free      - release a slot. Does not sleep, so it can be
+ *                     called with the coremap lock held.
+ *
+ *    swap_pagein    - read the slot at SWAPADDR into physical page
+ *                     PADDR.
+ *
+ *    swap_pageout   - write physical page PADDR to the slot at
+ *                     SWAPADDR.
+ *
+ *    swap_dup       - copy the slot at SWAPADDR to a new slot, for
+ *                     fork.
+ *
+ *    swap_printstats - print slot usage and I/O counts.
+ *
+ * The page being transferred must be pinned by the caller for the
+ * duration of swap_pagein/swap_pageout.
+ */
+
+#define SWAP_DISK   "lhd1"
+#define SWAP_DEVICE "lhd1raw:"
+#define SWAP_SCHED  "deadline"	/* page-ins are reads someone waits on */
+
+void swap_bootstrap(void);
+int swap_alloc(off_t *swapaddr);
+void swap_free(off_t swapaddr);
+int swap_pagein(paddr_t paddr, off_t swapaddr);
+int swap_pageout(paddr_t paddr, off_t swapaddr);
+int swap_dup(off_t swapaddr, off_t *ret);
+void swap_printstats(void);
+
+
+#endif /* _SWAP_H_ */
@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -62,6 +63,13 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * Timed P: like P, but give up at DEADLINE (nanoseconds on the
+ * gettime_nsecs() clock). Returns true if the count was decremented,
+ * false if the deadline passed first.
+ */
+bool P_timed(struct semaphore *, uint64_t deadline);
+
 struct maleSemaphore
 {
 
@@ -73,6 +81,9 @@ struct maleSemaphore
  * When the lock is created, no thread should be holding it. Likewise,
  * when the lock is destroyed, no thread should be holding it.
  *
+ * Locks are adaptive: a thread that finds the lock held spins while
+ * the holder is running on another CPU, and sleeps only if it isn't.
+ *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
  */
@@ -80,8 +91,14 @@ struct lock {
         char *lk_name;
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
-        volatile struct thread *lk_thread;
+        struct thread *volatile lk_thread;
+        struct cpu *volatile lk_cpu;    /* where lk_thread got it */
         volatile int lk_status;
+        unsigned lk_waiters;            /* threads asleep on lk_wchan */
+#if OPT_LOCKSTAT
+        struct lockstat *lk_stat;       /* record of current acquisition */
+        uint64_t lk_acqtime;            /* when it was acquired */
+#endif
         // add what you need here
         // (don't forget to mark things volatile as needed)
 };
@@ -104,6 +121,12 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Timed lock_acquire: give up at DEADLINE (nanoseconds on the
+ * gettime_nsecs() clock). Returns true if the lock was acquired.
+ */
+bool lock_acquire_timed(struct lock *, uint64_t deadline);
+
 
 /*
  * Condition variable.
@@ -148,6 +171,13 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * Timed cv_wait: stop waiting at DEADLINE (nanoseconds on the
+ * gettime_nsecs() clock) even if not woken. The lock is reacquired
+ * either way. Returns false if the deadline passed without a wakeup.
+ */
+bool cv_wait_timed(struct cv *cv, struct lock *lock, uint64_t deadline);
+
 /*
  * Reader-writer locks.
  *
@@ -56,20 +56,17 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
  * Prototypes for IN-KERNEL entry points for system call implementations.
  */
 
- struct file_handle {
-
-	int flags;
-	off_t offset;
-	int ref_count;
-	struct lock* filelock;
-	struct vnode* vnode;
-};
-
 int initial_ftable(void);
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_close(int fd, int *retval);
 int sys_read(int fd, void *buf, size_t buflen, int *retval);
 int sys_write(int fd, const void *buf, size_t nbytes, int *retval);
+int sys_pread(int fd, void *buf, size_t buflen, off_t pos, int *retval);
+int sys_pwrite(int fd, const void *buf, size_t nbytes, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval);
 int sys_lseek(int fd, off_t pos, int whence, off_t *retval_high);
 int sys_chdir(const char *pathname);
 int sys__getcwd(char *buf, size_t buflen, int *retval);
@@ -82,11 +79,16 @@ pid_t sys_fork(struct trapframe *parent_tf, int *retval);
 pid_t sys_waitpid(pid_t pid, int *status, int options, int *retval, bool is_kernel);
 void sys_exit(int exitcode);
 int sys_execv(userptr_t program, char** user_args);
+int sys_spawn(userptr_t program, userptr_t user_args, const_userptr_t user_actions, int nactions, int *retval);
 // void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr, vaddr_t entrypoint);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 int sbrk(intptr_t amount, int *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd, off_t offset, int *retval);
+int sys_munmap(userptr_t addr, size_t len, int *retval);
+int sys_fsync(int fd, int *retval);
 
 #endif /* _SYSCALL_H_ */
@@ -61,6 +61,7 @@ int semtest(int, char **);
 int locktest(int, char **);
 int locktest2(int, char **);
 int locktest3(int, char **);
+int locktest4(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
 int cvtest3(int, char **);
@@ -96,6 +97,9 @@ int semu20(int, char **);
 int semu21(int, char **);
 int semu22(int, char **);
 
+/* timer tests */
+int timertest(int, char **);
+
 /* filesystem tests */
 int fstest(int, char **);
 int readstress(int, char **);
@@ -103,6 +107,7 @@ int writestress(int, char **);
 int writestress2(int, char **);
 int longstress(int, char **);
 int createstress(int, char **);
+int readbench(int, char **);
 int printfile(int, char **);
 
 /* HMAC/hash tests */
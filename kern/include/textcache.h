@@ -0,0 +1,61 @@
+#ifndef _TEXTCACHE_H_
+#define _TEXTCACHE_H_
+
+/*
+ * Shared pages of read-only program segments.
+ *
+ * Every process running the same executable would otherwise read its
+ * own copy of the program text from the file on first touch. Instead,
+ * the first process to fault in a read-only page of a file-backed
+ * segment enters the frame here, keyed by the executable's vnode and
+ * the page's virtual address (the same for every process running that
+ * file, since the layout comes from the ELF headers), and the others
+ * map that frame.
+ *
+ * The cache holds one coremap reference on each frame, and each
+ * process mapping it holds another, the same way copy-on-write pages
+ * are shared after fork. Frames with more than one reference are
+ * never picked for eviction, so text in use stays resident; frames
+ * only the cache still refers to are given back by textcache_trim
+ * when memory runs low. Each cached file is held open with
+ * VOP_INCREF so its vnode can't be recycled for a different file.
+ *
+ *    textcache_lookup     - return the frame cached for (VN, VADDR)
+ *                           with a new reference for the caller, or 0.
+ *
+ *    textcache_generation - VN's generation number, which changes
+ *                           every time VN is invalidated. Get it before
+ *                           reading a page to insert.
+ *
+ *    textcache_insert     - offer frame PADDR, freshly filled from VN,
+ *                           as the copy of (VN, VADDR). GEN is what
+ *                           textcache_generation returned before the
+ *                           page was read. The caller keeps its own
+ *                           reference. Does nothing if the page is
+ *                           already cached, VN has been written since
+ *                           GEN, or there's no memory for the entry.
+ *
+ *    textcache_invalidate - forget every page of VN, because the file
+ *                           has been written. Processes that already
+ *                           map them keep their frames. Cheap when VN
+ *                           has nothing cached.
+ *
+ *    textcache_trim       - free up to NPAGES frames that nobody but the
+ *                           cache is using. Returns how many it freed.
+ *                           May sleep.
+ *
+ *    textcache_printstats - print entry and hit counts.
+ */
+
+struct vnode;
+
+paddr_t textcache_lookup(struct vnode *vn, vaddr_t vaddr);
+unsigned textcache_generation(struct vnode *vn);
+void textcache_insert(struct vnode *vn, vaddr_t vaddr, paddr_t paddr,
+		      unsigned gen);
+void textcache_invalidate(struct vnode *vn);
+unsigned textcache_trim(unsigned npages);
+void textcache_printstats(void);
+
+
+#endif /* _TEXTCACHE_H_ */
@@ -52,6 +52,14 @@ struct cpu;
 #define STACK_SIZE 4096
 #define MAX_NAME_LENGTH 64
 
+/*
+ * Scheduler levels. A thread at priority P runs for SCHED_QUANTUM(P)
+ * hardclocks before dropping to P+1, so CPU hogs sink to long, rare
+ * time slices and threads that block early stay near the top.
+ */
+#define SCHED_NLEVELS 4
+#define SCHED_QUANTUM(pri) (1U << (pri))
+
 /* Mask for extracting the stack base address of a kernel stack pointer */
 #define STACK_MASK  (~(vaddr_t)(STACK_SIZE-1))
 
@@ -96,6 +104,14 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduling state; see schedule() in thread.c. Changed by
+	 * the thread's own cpu while it runs, and otherwise only with
+	 * its cpu's run queue lock held.
+	 */
+	unsigned t_priority;		/* 0 (highest) to SCHED_NLEVELS-1 */
+	unsigned t_ticksleft;		/* hardclocks left in its quantum */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -119,9 +135,6 @@ struct thread {
 
 	/* add more here as needed */
 
-	/* Filetable */
-	struct file_handle *file_table[OPEN_MAX];
-
 	/* PID Management */
 	pid_t t_pid;
 	pid_t ppid;
@@ -181,6 +194,13 @@ void thread_yield(void);
  */
 void schedule(void);
 
+/*
+ * Charge the current thread for one hardclock. Returns true if it
+ * should yield: its quantum is used up, or a thread of higher
+ * priority is waiting. Called from the timer interrupt.
+ */
+bool thread_timeslice(void);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
@@ -0,0 +1,78 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timeouts.
+ *
+ * A timer calls a function at (or shortly after) a deadline given in
+ * nanoseconds on the gettime_nsecs() clock. Timers are kept per cpu,
+ * on the cpu that added them, and run from that cpu's timer interrupt
+ * with interrupts off and no locks held; the function must not sleep.
+ *
+ * Each cpu's timers are on a hashed timer wheel: TIMER_WHEELSIZE
+ * slots, each covering 1 << TIMER_SLOTSHIFT nanoseconds (about 8ms),
+ * a timer going in the slot of its deadline modulo the wheel size.
+ * Each slot's list is sorted by deadline, so adding is a short walk
+ * and running the due timers only looks at the heads of the slots
+ * the clock has passed. The timer interrupt is programmed for the
+ * earliest deadline, so timers fire with sub-tick resolution.
+ *
+ *    timer_init   - set up T to call FUNC(DATA).
+ *
+ *    timer_add    - arrange for T to fire at DEADLINE, on this cpu.
+ *                   T must not already be pending. A deadline already
+ *                   past fires at the next timer interrupt.
+ *
+ *    timer_cancel - stop T from firing. Returns true if it was still
+ *                   pending, false if it already fired (or was never
+ *                   added). If it is firing on some other cpu right
+ *                   now, waits for the function to return, so once
+ *                   this returns T and DATA can be freed. Must not be
+ *                   called with any lock the function takes.
+ *
+ * The rest is for the clock code (see clock.c):
+ *
+ *    timer_bootstrap - set up the calling cpu's wheel.
+ *    timer_run       - call the functions of this cpu's timers that are
+ *                      due by NOW.
+ *    timer_next      - return this cpu's earliest deadline, or
+ *                      TIMER_NEVER if it has no timers.
+ */
+
+#include <spinlock.h>
+
+#define TIMER_WHEELSIZE 64
+#define TIMER_SLOTSHIFT 23
+#define TIMER_NEVER ((uint64_t)-1)
+
+struct cpu;
+
+typedef void (*timer_func)(void *data);
+
+struct timer {
+	uint64_t tm_deadline;
+	timer_func tm_func;
+	void *tm_data;
+	struct cpu *tm_cpu;		/* cpu it was added on */
+	struct timer *tm_next;		/* in its slot, if pending */
+	struct timer **tm_prevp;	/* NULL if not pending */
+};
+
+struct timerwheel {
+	struct spinlock tw_lock;
+	struct timer *tw_slots[TIMER_WHEELSIZE];
+	uint64_t tw_runslot;		/* slot timer_run got up to */
+	unsigned tw_count;		/* pending timers */
+	struct timer *tw_running;	/* one whose function is being called */
+};
+
+void timer_init(struct timer *t, timer_func func, void *data);
+void timer_add(struct timer *t, uint64_t deadline);
+bool timer_cancel(struct timer *t);
+
+void timer_bootstrap(struct timerwheel *tw);
+void timer_run(uint64_t now);
+uint64_t timer_next(void);
+
+
+#endif /* _TIMER_H_ */
@@ -157,6 +157,14 @@ int vfs_getcwd(struct uio *buf);
  *                    specified device.
  *
  *    vfs_unmountall - Unmount all mounted filesystems.
+ *
+ *    vfs_setsched  - Choose the I/O scheduler ("fifo", "clook" or
+ *                    "deadline") for the device DEVNAME, which must be
+ *                    mountable. Takes effect for requests already
+ *                    waiting too.
+ *
+ *    vfs_printdevstats - Print statistics for every device that
+ *                    keeps them.
  */
 
 void vfs_bootstrap(void);
@@ -173,6 +181,8 @@ int vfs_mount(const char *devname, void *data,
 			       struct fs **result));
 int vfs_unmount(const char *devname);
 int vfs_unmountall(void);
+int vfs_setsched(const char *devname, const char *schedname);
+void vfs_printdevstats(void);
 
 /*
  * Array of vnodes.
@@ -46,7 +46,11 @@
 #define VM_FAULT_READONLY    2    /* A write to a readonly page was attempted*/
 
 
-/* Initialization function */
+/*
+ * Initialization functions. initializeCoremap takes over physical
+ * memory right after ram_bootstrap; vm_bootstrap starts swap and the
+ * pageout daemon once threads and devices are up.
+ */
 void vm_bootstrap(void);
 
 /* Fault handling function called by trap code */
@@ -63,18 +67,71 @@ void free_kpages(vaddr_t addr);
  */
 unsigned int coremap_used_bytes(void);
 
+/*
+ * Frame reference counts for copy-on-write sharing. alloc_kpages
+ * hands out single pages with a count of one; page_share adds a
+ * reference and free_kpages drops one, freeing the frame on the last.
+ */
+void page_share(paddr_t paddr);
+unsigned page_refcount(paddr_t paddr);
+
+/*
+ * User pages.
+ *
+ *    page_alloc   - get a frame for AS to map at VADDR, evicting a
+ *                   page to swap if memory is full. The frame comes
+ *                   back pinned; page_unpin it once it is in the
+ *                   page table. Returns 0 if nothing can be freed.
+ *
+ *    page_release - drop AS's reference to a frame. If the frame is
+ *                   being evicted from AS at the time, waits for that
+ *                   to finish and returns false without doing
+ *                   anything: the caller should read its PTE again.
+ *                   Must not be called with AS's as_lock held.
+ *
+ *    page_sync    - if the page at VADDR in a shared file mapping of AS
+ *                   is dirty, write it to the file and mark it clean.
+ *                   Must not be called with AS's as_lock held.
+ */
+struct addrspace;
+paddr_t page_alloc(struct addrspace *as, vaddr_t vaddr);
+void page_unpin(paddr_t paddr);
+bool page_release(paddr_t paddr, struct addrspace *as);
+int page_sync(struct addrspace *as, vaddr_t vaddr);
+
+/* Print per-cpu page cache hit/miss/refill counts (kernel menu). */
+void coremap_printcachestats(void);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown_all(void);
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/*
+ * Coremap. There is one entry per physical frame, indexed directly by
+ * physical frame number (paddr / PAGE_SIZE). Free frames are kept in
+ * power-of-two buddy blocks; the head entry of each free block sits
+ * on the free list for its order, linked through next_free/prev_free.
+ *
+ * refcount counts the page tables mapping a user frame; after a
+ * copy-on-write fork it is greater than one until one side writes.
+ * is_pinned keeps a frame where it is while it is being paged in or
+ * out or handed to a new owner.
+ */
 struct coremap_entry{
-	paddr_t ps_padder;
-	off_t ps_swapaddr;
+	off_t ps_swapaddr;		/* clean copy in swap, or 0 */
+	struct addrspace *owner;	/* user page: who maps it, or NULL */
+	vaddr_t owner_vaddr;		/* ...and where */
+	unsigned block_length;		/* pages in allocation (head only) */
+	unsigned refcount;		/* address spaces sharing the frame */
+	bool referenced;		/* clock bit; set without core_lock */
+	unsigned next_free;		/* buddy free list links */
+	unsigned prev_free;
 	unsigned int cpu_index : 4;
 	int tlb_index : 7;
-	int block_length : 4;
+	unsigned int order : 5;		/* buddy order (free head only) */
 	bool is_allocated : 1;
 	bool is_pinned : 1;
+	bool is_free_head : 1;		/* heads a block on a free list */
 };
 
 void initializeCoremap(void);
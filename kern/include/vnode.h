@@ -51,7 +51,9 @@ struct stat;
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
-	struct spinlock vn_countlock;   /* Lock for vn_refcount */
+	struct spinlock vn_countlock;   /* Lock for vn_refcount and vn_text* */
+	unsigned vn_textgen;            /* Text cache generation */
+	bool vn_textcached;             /* Has pages in the text cache */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -42,6 +42,7 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <vm.h>
 #include <machine/coremap.h>
 #include <mainbus.h>
@@ -53,6 +54,11 @@
 #include <version.h>
  #include <coremap.h>
 #include "autoconf.h"  // for pseudoconfig
+#include "opt-sfs.h"
+
+#if OPT_SFS
+#include <sfs.h>
+#endif
 
 
 /*
@@ -111,11 +117,14 @@ boot(void)
 	/* Early initialization. */
 	ram_bootstrap();
 	//Initialize Coremap here
-	vm_bootstrap();
+	initializeCoremap();
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+#if OPT_SFS
+	sfs_bootstrap();
+#endif
 	kheap_nextgeneration();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -123,6 +132,10 @@ boot(void)
 	KASSERT(curthread->t_curspl > 0);
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
+#if OPT_LOCKSTAT
+	/* Needs the clock. */
+	lockstat_bootstrap();
+#endif
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
@@ -136,6 +149,9 @@ boot(void)
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
 
+	/* Swap and the pageout daemon. */
+	vm_bootstrap();
+
 	kheap_nextgeneration();
 
 	/*
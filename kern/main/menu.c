@@ -38,11 +38,13 @@
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
+#include <vm.h>
 #include <sfs.h>
 // #include <synch.h>
 #include <syscall.h>
 #include <test.h>
 #include <prompt.h>
+#include <lockstat.h>
 // #include "opt-sfs.h"
 #include "opt-net.h"
 #include "opt-synchprobs.h"
@@ -161,7 +163,6 @@ common_prog(int nargs, char **args)
 	int result;
 	unsigned tc;
 	int status=0, retval=0;
-	int j;
 	// int res;
 
 	/* Create a process for the new program to run in. */
@@ -170,14 +171,7 @@ common_prog(int nargs, char **args)
 		return ENOMEM;
 	}
 
-	proc->ppid = curproc->pid;
-
-	for(j=PID_MIN; j<MAX_PROC; ++j){
-		if(proc_table[j] == NULL){
-			proc_table[j] = proc;
-			break;
-		}
-	}
+	proc_addchild(curproc, proc);
 
 	tc = thread_count;
 	
@@ -191,6 +185,7 @@ common_prog(int nargs, char **args)
 
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
+		proc_remchild(proc);
 		proc_destroy(proc);
 		return result;
 	}
@@ -365,9 +360,10 @@ cmd_mount(int nargs, char **args)
 	char *fstype;
 	char *device;
 	unsigned i;
+	int result;
 
-	if (nargs != 3) {
-		kprintf("Usage: mount fstype device:\n");
+	if (nargs != 3 && nargs != 4) {
+		kprintf("Usage: mount fstype device: [fifo|clook|deadline]\n");
 		return EINVAL;
 	}
 
@@ -379,6 +375,16 @@ cmd_mount(int nargs, char **args)
 		device[strlen(device)-1] = 0;
 	}
 
+	/* Optional I/O scheduler for the device */
+	if (nargs == 4) {
+		result = vfs_setsched(device, args[3]);
+		if (result) {
+			kprintf("mount: scheduler %s: %s\n", args[3],
+				strerror(result));
+			return result;
+		}
+	}
+
 	for (i=0; i<ARRAYCOUNT(mounttable); i++) {
 		if (!strcmp(mounttable[i].name, fstype)) {
 			return mounttable[i].func(device);
@@ -474,6 +480,33 @@ cmd_kheapgeneration(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_pagecachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	coremap_printcachestats();
+
+	return 0;
+}
+
+static
+int
+cmd_devstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vfs_printdevstats();
+#if OPT_SFS
+	sfs_printstats();
+#endif
+
+	return 0;
+}
+
 static
 int
 cmd_kheapdump(int nargs, char **args)
@@ -491,6 +524,30 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int n = 10;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	if (nargs == 2) {
+		n = atoi(args[1]);
+	}
+	if (nargs > 2 || n <= 0) {
+		kprintf("Usage: lks [count | reset]\n");
+		return EINVAL;
+	}
+	lockstat_dump(n);
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -566,6 +623,7 @@ static const char *testmenu[] = {
 	"[lt1]  Lock test 1           (1)    ",
 	"[lt2]  Lock test 2           (1*)   ",
 	"[lt3]  Lock test 3           (1*)   ",
+	"[lt4]  Lock contention bench (1)    ",
 	"[cvt1] CV test 1             (1)    ",
 	"[cvt2] CV test 2             (1)    ",
 	"[cvt3] CV test 3             (1*)   ",
@@ -581,12 +639,14 @@ static const char *testmenu[] = {
 	"[sp2] Stoplight test         (1)    ",
 #endif
 	"[semu1-22] Semaphore unit tests     ",
+	"[tmt1] Timer test                   ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[fs7] FS read throughput benchmark  ",
 	"[hm1] HMAC unit test                ",
 	NULL
 };
@@ -638,6 +698,11 @@ static const char *mainmenu[] = {
 	"[khu] Kernel heap usage             ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[pcs] Per-CPU page cache stats      ",
+	"[ds] Disk, queue and buffer stats   ",
+#if OPT_LOCKSTAT
+	"[lks] Lock contention stats         ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -691,6 +756,11 @@ static struct {
 	{ "khu",        cmd_kheapused },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "pcs",        cmd_pagecachestats },
+	{ "ds",         cmd_devstats },
+#if OPT_LOCKSTAT
+	{ "lks",        cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -714,6 +784,7 @@ static struct {
 	{ "lt1",	locktest },
 	{ "lt2",	locktest2 },
 	{ "lt3",	locktest3 },
+	{ "lt4",	locktest4 },
 	{ "cvt1",	cvtest },
 	{ "cvt2",	cvtest2 },
 	{ "cvt3",	cvtest3 },
@@ -753,6 +824,9 @@ static struct {
 	{ "semu21",	semu21 },
 	{ "semu22",	semu22 },
 
+	/* timer tests */
+	{ "tmt1",	timertest },
+
 	/* file system assignment tests */
 	{ "fs1",	fstest },
 	{ "fs2",	readstress },
@@ -760,6 +834,7 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "fs7",	readbench },
 
 	/* HMAC unit tests */
 	{ "hm1",	hmacu1 },
@@ -49,8 +49,10 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <synch.h>
+#include <fdtable.h>
 #include <kern/errno.h>
 #include <kern/wait.h>
+#include <limits.h>
 
 
 /*
@@ -58,15 +60,252 @@
  */
 struct proc *kproc;
 struct lock* proc_lock;
-int allocate_pid = 2;
 
-pid_t givepid(void) {
-	pid_t i;
-	for(i = PID_MIN; i<MAX_PROC; i++){
-		if(proc_table[i]==NULL)
-			return i;
+/*
+ * Process IDs.
+ *
+ * Free PIDs are tracked in a bitmap. Allocation scans forward from a
+ * cursor left just past the last PID handed out, so a PID that was just
+ * freed isn't reused until the rest of the space has been cycled
+ * through; full words are skipped 32 PIDs at a time. Live processes
+ * are found by PID through a hash table chained on p_hashnext.
+ *
+ * Both are protected by pid_lock, a spinlock, so lookups are cheap and
+ * can be made from anywhere.
+ */
+#define PID_WORDS	DIVROUNDUP(PROC_MAXPID + 1, 32)
+
+static uint32_t pid_used[PID_WORDS];
+static struct proc *pid_hash[PROC_HASHSIZE];
+static pid_t pid_cursor = PID_MIN;
+static unsigned pid_count;
+static struct spinlock pid_lock = SPINLOCK_INITIALIZER;
+
+#define PID_HASH(pid)	((unsigned)(pid) % PROC_HASHSIZE)
+#define PID_ISSET(pid)	(pid_used[(pid) / 32] & ((uint32_t)1 << ((pid) % 32)))
+
+/*
+ * Give PROC a PID and make it findable with proc_lookup. Fails with
+ * ENPROC if every PID is in use.
+ */
+static
+int
+pid_alloc(struct proc *proc)
+{
+	pid_t pid;
+	unsigned tries;
+
+	spinlock_acquire(&pid_lock);
+	if (pid_count == PROC_MAXPID - PID_MIN + 1) {
+		spinlock_release(&pid_lock);
+		return ENPROC;
+	}
+
+	pid = pid_cursor;
+	for (tries = 0; ; tries++) {
+		KASSERT(tries <= PROC_MAXPID + 1);
+		if (pid > PROC_MAXPID) {
+			pid = PID_MIN;
+		}
+		if (pid % 32 == 0 && pid_used[pid / 32] == 0xffffffff) {
+			pid += 32;
+			continue;
+		}
+		if (!PID_ISSET(pid)) {
+			break;
+		}
+		pid++;
+	}
+
+	pid_used[pid / 32] |= (uint32_t)1 << (pid % 32);
+	pid_count++;
+	pid_cursor = pid + 1;
+
+	proc->pid = pid;
+	proc->p_hashnext = pid_hash[PID_HASH(pid)];
+	pid_hash[PID_HASH(pid)] = proc;
+	spinlock_release(&pid_lock);
+	return 0;
+}
+
+/*
+ * Release PID and forget the process that had it.
+ */
+static
+void
+pid_free(pid_t pid)
+{
+	struct proc **pp;
+
+	KASSERT(pid >= PID_MIN && pid <= PROC_MAXPID);
+
+	spinlock_acquire(&pid_lock);
+	KASSERT(PID_ISSET(pid));
+	for (pp = &pid_hash[PID_HASH(pid)]; *pp != NULL;
+	     pp = &(*pp)->p_hashnext) {
+		if ((*pp)->pid == pid) {
+			*pp = (*pp)->p_hashnext;
+			break;
+		}
+	}
+	pid_used[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+	pid_count--;
+	spinlock_release(&pid_lock);
+}
+
+struct proc *
+proc_lookup(pid_t pid)
+{
+	struct proc *proc;
+
+	if (pid < PID_MIN || pid > PROC_MAXPID) {
+		return NULL;
+	}
+
+	spinlock_acquire(&pid_lock);
+	for (proc = pid_hash[PID_HASH(pid)]; proc != NULL;
+	     proc = proc->p_hashnext) {
+		if (proc->pid == pid) {
+			break;
+		}
+	}
+	spinlock_release(&pid_lock);
+	return proc;
+}
+
+/*
+ * Process families.
+ *
+ * Each process keeps its running children and its exited but not yet
+ * waited-for children (zombies) on two lists, the zombies in the order
+ * they exited, so waiting for any child takes the first zombie without
+ * searching. An exiting child moves itself to its parent's zombie list
+ * and signals the parent's p_waitcv. proc_lock covers all of it.
+ */
+
+static
+void
+proclist_append(struct proclist *pl, struct proc *proc)
+{
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = pl->pl_tail;
+	if (pl->pl_tail != NULL) {
+		pl->pl_tail->p_sibnext = proc;
+	}
+	else {
+		pl->pl_head = proc;
+	}
+	pl->pl_tail = proc;
+}
+
+static
+void
+proclist_remove(struct proclist *pl, struct proc *proc)
+{
+	if (proc->p_sibprev != NULL) {
+		proc->p_sibprev->p_sibnext = proc->p_sibnext;
+	}
+	else {
+		pl->pl_head = proc->p_sibnext;
+	}
+	if (proc->p_sibnext != NULL) {
+		proc->p_sibnext->p_sibprev = proc->p_sibprev;
+	}
+	else {
+		pl->pl_tail = proc->p_sibprev;
+	}
+	proc->p_sibprev = proc->p_sibnext = NULL;
+}
+
+void
+proc_addchild(struct proc *parent, struct proc *child)
+{
+	lock_acquire(proc_lock);
+	KASSERT(child->p_parent == NULL);
+	child->p_parent = parent;
+	child->ppid = parent->pid;
+	proclist_append(&parent->p_children, child);
+	lock_release(proc_lock);
+}
+
+void
+proc_remchild(struct proc *child)
+{
+	lock_acquire(proc_lock);
+	KASSERT(!child->exited);
+	if (child->p_parent != NULL) {
+		proclist_remove(&child->p_parent->p_children, child);
+		child->p_parent = NULL;
 	}
-	return -1;
+	lock_release(proc_lock);
+}
+
+/*
+ * Free an exited process. Called with proc_lock held: sys_waitpid
+ * looks at whatever proc_lookup finds while holding it, so the PID
+ * has to be gone before the lock is let go.
+ */
+static
+void
+proc_free(struct proc *proc)
+{
+	KASSERT(lock_do_i_hold(proc_lock));
+	KASSERT(proc->exited);
+	KASSERT(proc->p_numthreads == 0);
+	KASSERT(proc->p_addrspace == NULL);
+	KASSERT(proc->p_fdtable == NULL);
+	KASSERT(proc->p_parent == NULL);
+
+	cv_destroy(proc->p_waitcv);
+	pid_free(proc->pid);
+	spinlock_cleanup(&proc->p_lock);
+	kfree(proc->p_name);
+	kfree(proc);
+}
+
+void
+proc_exited(struct proc *proc, int status)
+{
+	struct proc *child;
+
+	KASSERT(proc->p_numthreads == 0);
+
+	lock_acquire(proc_lock);
+
+	/* Nobody will wait for our children now. */
+	while ((child = proc->p_children.pl_head) != NULL) {
+		proclist_remove(&proc->p_children, child);
+		child->p_parent = NULL;
+	}
+	while ((child = proc->p_zombies.pl_head) != NULL) {
+		proclist_remove(&proc->p_zombies, child);
+		child->p_parent = NULL;
+		proc_free(child);
+	}
+
+	proc->exitcode = status;
+	proc->exited = true;
+	if (proc->p_parent == NULL) {
+		proc_free(proc);
+		lock_release(proc_lock);
+		return;
+	}
+	proclist_remove(&proc->p_parent->p_children, proc);
+	proclist_append(&proc->p_parent->p_zombies, proc);
+	cv_broadcast(proc->p_parent->p_waitcv, proc_lock);
+	lock_release(proc_lock);
+}
+
+void
+proc_reap(struct proc *proc)
+{
+	lock_acquire(proc_lock);
+	if (proc->p_parent != NULL) {
+		proclist_remove(&proc->p_parent->p_zombies, proc);
+		proc->p_parent = NULL;
+	}
+	proc_free(proc);
+	lock_release(proc_lock);
 }
 
 /*
@@ -76,7 +315,6 @@ pid_t givepid(void) {
 struct proc *proc_create(const char *name)
 {
 	struct proc *proc;
-	int j;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -96,24 +334,30 @@ struct proc *proc_create(const char *name)
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
+	proc->p_fdtable = NULL;
 
 	proc->ppid = 0;
-	proc->pid = allocate_pid;
-	
-	for(j=PID_MIN; j<MAX_PROC; ++j){
-		if(proc_table[j]==NULL && j!=allocate_pid){
-			allocate_pid = j;
-			break;
-		}
+	if (pid_alloc(proc)) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
 	}
 
 	proc->exited = false;
 	proc->exitcode = 0;
 	proc->self = curthread;
 
-	struct semaphore *sem;
-	sem = sem_create("child", 0);
-	proc->exitsem = sem;
+	proc->p_parent = NULL;
+	proc->p_children.pl_head = proc->p_children.pl_tail = NULL;
+	proc->p_zombies.pl_head = proc->p_zombies.pl_tail = NULL;
+	proc->p_sibprev = proc->p_sibnext = NULL;
+	proc->p_waitcv = cv_create("waitpid");
+	if (proc->p_waitcv == NULL) {
+		pid_free(proc->pid);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 	
 	/* if(proc_table == NULL){
 		count_proc = 1;
@@ -167,14 +411,14 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != kproc);
 	pid_t i = proc->pid;
 
-	sem_destroy(proc->exitsem);
-
-	kprintf("About to free from proc_table. My PID is: %d..\n", i);
-
-	//lock_acquire(proc_lock);
-	kfree(proc_table[i]);
-	//lock_release(proc_lock);
-
+	KASSERT(proc->p_parent == NULL);
+	KASSERT(proc->p_children.pl_head == NULL);
+	KASSERT(proc->p_zombies.pl_head == NULL);
+	cv_destroy(proc->p_waitcv);
+	/* See proc_free. */
+	lock_acquire(proc_lock);
+	pid_free(i);
+	lock_release(proc_lock);
 
 	/*
 	 * We don't take p_lock in here because we must have the only
@@ -183,12 +427,15 @@ proc_destroy(struct proc *proc)
 	 */
 
 	/* VFS fields */
-	kprintf("Doing DEC_REF...\n");
 
 	// if (proc->p_cwd) {
 	// 	VOP_DECREF(proc->p_cwd);
 	// 	proc->p_cwd = NULL;
 	// }
+	if (proc->p_fdtable) {
+		fdtable_destroy(proc->p_fdtable);
+		proc->p_fdtable = NULL;
+	}
 
 	/* VM fields */
 	if (proc->p_addrspace) {
@@ -226,8 +473,6 @@ proc_destroy(struct proc *proc)
 		 * random other process while it's still running...
 		 */
 		struct addrspace *as;
-		kprintf("Clearing addrspace...\n");
-
 
 		if (proc == curproc) {
 			as = proc_setas(NULL);
@@ -239,12 +484,9 @@ proc_destroy(struct proc *proc)
 		}
 		as_destroy(as);
 	}
-	kprintf("In proc_destroy.. p_numthreads should be 0. But actually are: %d\n", proc->p_numthreads);
-
 
 	KASSERT(proc->p_numthreads == 0);
 	spinlock_cleanup(&proc->p_lock);
-	kprintf("Everything good. freeing..\n");
 
 
 	kfree(proc->p_name);
@@ -262,7 +504,7 @@ proc_bootstrap(void)
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
 	}
-	proc_table[PID_MIN] = kproc;
+	KASSERT(kproc->pid == PID_MIN);
 }
 
 /*
@@ -0,0 +1,455 @@
+/*
+ * Open file handles and file descriptor tables. See <fdtable.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vfs.h>
+#include <fdtable.h>
+
+/*
+ * Free handles. They keep their filelock and ref_lock for reuse.
+ */
+static struct file_handle *fh_freelist;
+static struct spinlock fh_freelock = SPINLOCK_INITIALIZER;
+
+int
+fh_create(struct vnode *vn, int flags, off_t offset, struct file_handle **ret)
+{
+	struct file_handle *fh;
+
+	spinlock_acquire(&fh_freelock);
+	fh = fh_freelist;
+	if (fh != NULL) {
+		fh_freelist = fh->next_free;
+	}
+	spinlock_release(&fh_freelock);
+
+	if (fh == NULL) {
+		fh = kmalloc(sizeof(*fh));
+		if (fh == NULL) {
+			return ENOMEM;
+		}
+		fh->filelock = lock_create("filelock");
+		if (fh->filelock == NULL) {
+			kfree(fh);
+			return ENOMEM;
+		}
+		spinlock_init(&fh->ref_lock);
+		fh->ref_count = 0;
+	}
+
+	KASSERT(fh->ref_count == 0);
+	fh->flags = flags;
+	fh->offset = offset;
+	fh->vnode = vn;
+	fh->next_free = NULL;
+
+	/* The count going nonzero is what makes the handle live. */
+	membar_store_store();
+	spinlock_acquire(&fh->ref_lock);
+	fh->ref_count = 1;
+	spinlock_release(&fh->ref_lock);
+
+	*ret = fh;
+	return 0;
+}
+
+void
+fh_incref(struct file_handle *fh)
+{
+	spinlock_acquire(&fh->ref_lock);
+	KASSERT(fh->ref_count > 0);
+	fh->ref_count++;
+	spinlock_release(&fh->ref_lock);
+}
+
+void
+fh_decref(struct file_handle *fh)
+{
+	bool last;
+
+	spinlock_acquire(&fh->ref_lock);
+	KASSERT(fh->ref_count > 0);
+	fh->ref_count--;
+	last = (fh->ref_count == 0);
+	spinlock_release(&fh->ref_lock);
+
+	if (!last) {
+		return;
+	}
+
+	vfs_close(fh->vnode);
+	fh->vnode = NULL;
+
+	spinlock_acquire(&fh_freelock);
+	fh->next_free = fh_freelist;
+	fh_freelist = fh;
+	spinlock_release(&fh_freelock);
+}
+
+/*
+ * Take a reference on FH unless its count has already dropped to
+ * zero (it's being closed, or is on the free list).
+ */
+static
+bool
+fh_tryincref(struct file_handle *fh)
+{
+	bool ok;
+
+	spinlock_acquire(&fh->ref_lock);
+	ok = (fh->ref_count > 0);
+	if (ok) {
+		fh->ref_count++;
+	}
+	spinlock_release(&fh->ref_lock);
+	return ok;
+}
+
+////////////////////////////////////////////////////////////
+// Slot arrays
+
+#define FD_WORDS(n) DIVROUNDUP(n, 32)
+
+static
+struct fdarray *
+fdarray_create(unsigned size)
+{
+	struct fdarray *fa;
+	unsigned i;
+
+	fa = kmalloc(sizeof(*fa));
+	if (fa == NULL) {
+		return NULL;
+	}
+	fa->fa_slots = kmalloc(size * sizeof(fa->fa_slots[0]));
+	if (fa->fa_slots == NULL) {
+		kfree(fa);
+		return NULL;
+	}
+	fa->fa_used = kmalloc(FD_WORDS(size) * sizeof(uint32_t));
+	if (fa->fa_used == NULL) {
+		kfree(fa->fa_slots);
+		kfree(fa);
+		return NULL;
+	}
+	for (i = 0; i < size; i++) {
+		fa->fa_slots[i] = NULL;
+	}
+	for (i = 0; i < FD_WORDS(size); i++) {
+		fa->fa_used[i] = 0;
+	}
+	fa->fa_size = size;
+	fa->fa_older = NULL;
+	return fa;
+}
+
+static
+void
+fdarray_destroy(struct fdarray *fa)
+{
+	struct fdarray *older;
+
+	while (fa != NULL) {
+		older = fa->fa_older;
+		kfree(fa->fa_used);
+		kfree(fa->fa_slots);
+		kfree(fa);
+		fa = older;
+	}
+}
+
+static
+void
+fdarray_set(struct fdarray *fa, unsigned fd, struct file_handle *fh)
+{
+	/* Make sure the handle is fully set up before it's visible. */
+	membar_store_store();
+	fa->fa_slots[fd] = fh;
+	if (fh != NULL) {
+		fa->fa_used[fd / 32] |= (uint32_t)1 << (fd % 32);
+	}
+	else {
+		fa->fa_used[fd / 32] &= ~((uint32_t)1 << (fd % 32));
+	}
+}
+
+/*
+ * Grow FT so it has at least MINSIZE slots. The old array stays
+ * around for readers that already fetched it.
+ */
+static
+int
+fdtable_grow(struct fdtable *ft, unsigned minsize)
+{
+	struct fdarray *old = ft->ft_array, *fa;
+	unsigned size, i;
+
+	KASSERT(lock_do_i_hold(ft->ft_lock));
+
+	if (minsize > OPEN_MAX) {
+		return EMFILE;
+	}
+	size = old->fa_size;
+	while (size < minsize) {
+		size *= 2;
+	}
+	if (size > OPEN_MAX) {
+		size = OPEN_MAX;
+	}
+
+	fa = fdarray_create(size);
+	if (fa == NULL) {
+		return ENOMEM;
+	}
+	for (i = 0; i < old->fa_size; i++) {
+		fa->fa_slots[i] = old->fa_slots[i];
+	}
+	for (i = 0; i < FD_WORDS(old->fa_size); i++) {
+		fa->fa_used[i] = old->fa_used[i];
+	}
+	fa->fa_older = old;
+
+	membar_store_store();
+	ft->ft_array = fa;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Tables
+
+struct fdtable *
+fdtable_create(void)
+{
+	struct fdtable *ft;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	ft->ft_lock = lock_create("fdtable");
+	if (ft->ft_lock == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+	ft->ft_array = fdarray_create(FDTABLE_MINSIZE);
+	if (ft->ft_array == NULL) {
+		lock_destroy(ft->ft_lock);
+		kfree(ft);
+		return NULL;
+	}
+	ft->ft_lowfree = 0;
+	return ft;
+}
+
+int
+fdtable_copy(struct fdtable *old, struct fdtable **ret)
+{
+	struct fdtable *ft;
+	struct fdarray *ofa;
+	unsigned i;
+	int result;
+
+	ft = fdtable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(old->ft_lock);
+	ofa = old->ft_array;
+	if (ofa->fa_size > ft->ft_array->fa_size) {
+		lock_acquire(ft->ft_lock);
+		result = fdtable_grow(ft, ofa->fa_size);
+		lock_release(ft->ft_lock);
+		if (result) {
+			lock_release(old->ft_lock);
+			fdtable_destroy(ft);
+			return result;
+		}
+	}
+	for (i = 0; i < ofa->fa_size; i++) {
+		if (ofa->fa_slots[i] != NULL) {
+			fh_incref(ofa->fa_slots[i]);
+			fdarray_set(ft->ft_array, i, ofa->fa_slots[i]);
+		}
+	}
+	ft->ft_lowfree = old->ft_lowfree;
+	lock_release(old->ft_lock);
+
+	*ret = ft;
+	return 0;
+}
+
+void
+fdtable_destroy(struct fdtable *ft)
+{
+	struct fdarray *fa = ft->ft_array;
+	unsigned i;
+
+	for (i = 0; i < fa->fa_size; i++) {
+		if (fa->fa_slots[i] != NULL) {
+			fh_decref(fa->fa_slots[i]);
+		}
+	}
+	fdarray_destroy(fa);
+	lock_destroy(ft->ft_lock);
+	kfree(ft);
+}
+
+int
+fdtable_add(struct fdtable *ft, struct file_handle *fh, int *fd)
+{
+	struct fdarray *fa;
+	unsigned w, bit, slot;
+	int result;
+
+	lock_acquire(ft->ft_lock);
+	fa = ft->ft_array;
+
+	/* Find the first word at or past the hint with a clear bit. */
+	for (w = ft->ft_lowfree / 32; w < FD_WORDS(fa->fa_size); w++) {
+		if (fa->fa_used[w] != 0xffffffff) {
+			break;
+		}
+	}
+	slot = fa->fa_size;
+	if (w < FD_WORDS(fa->fa_size)) {
+		for (bit = 0; bit < 32; bit++) {
+			if ((fa->fa_used[w] & ((uint32_t)1 << bit)) == 0) {
+				break;
+			}
+		}
+		if (w * 32 + bit < fa->fa_size) {
+			slot = w * 32 + bit;
+		}
+	}
+
+	if (slot == fa->fa_size) {
+		result = fdtable_grow(ft, fa->fa_size + 1);
+		if (result) {
+			lock_release(ft->ft_lock);
+			return result;
+		}
+		fa = ft->ft_array;
+	}
+
+	fdarray_set(fa, slot, fh);
+	ft->ft_lowfree = slot + 1;
+	lock_release(ft->ft_lock);
+
+	*fd = slot;
+	return 0;
+}
+
+int
+fdtable_get(struct fdtable *ft, int fd, struct file_handle **ret)
+{
+	struct fdarray *fa;
+	struct file_handle *fh;
+
+	if (fd < 0) {
+		return EBADF;
+	}
+
+	while (1) {
+		fa = ft->ft_array;
+		membar_load_load();
+		if ((unsigned)fd >= fa->fa_size) {
+			return EBADF;
+		}
+		fh = fa->fa_slots[fd];
+		if (fh == NULL) {
+			return EBADF;
+		}
+		if (!fh_tryincref(fh)) {
+			/* Closed under us; look again. */
+			continue;
+		}
+		/*
+		 * The handle may have been closed and reused for some
+		 * other open between our load and the incref. It's ours
+		 * only if the slot still points to it.
+		 */
+		membar_load_load();
+		fa = ft->ft_array;
+		if ((unsigned)fd < fa->fa_size && fa->fa_slots[fd] == fh) {
+			*ret = fh;
+			return 0;
+		}
+		fh_decref(fh);
+	}
+}
+
+int
+fdtable_remove(struct fdtable *ft, int fd)
+{
+	struct fdarray *fa;
+	struct file_handle *fh;
+
+	lock_acquire(ft->ft_lock);
+	fa = ft->ft_array;
+	if (fd < 0 || (unsigned)fd >= fa->fa_size ||
+	    fa->fa_slots[fd] == NULL) {
+		lock_release(ft->ft_lock);
+		return EBADF;
+	}
+	fh = fa->fa_slots[fd];
+	fdarray_set(fa, fd, NULL);
+	if ((unsigned)fd < ft->ft_lowfree) {
+		ft->ft_lowfree = fd;
+	}
+	lock_release(ft->ft_lock);
+
+	fh_decref(fh);
+	return 0;
+}
+
+int
+fdtable_dup2(struct fdtable *ft, int oldfd, int newfd)
+{
+	struct fdarray *fa;
+	struct file_handle *fh, *prev;
+	int result;
+
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	lock_acquire(ft->ft_lock);
+	fa = ft->ft_array;
+	if (oldfd < 0 || (unsigned)oldfd >= fa->fa_size ||
+	    fa->fa_slots[oldfd] == NULL) {
+		lock_release(ft->ft_lock);
+		return EBADF;
+	}
+	fh = fa->fa_slots[oldfd];
+	if (oldfd == newfd) {
+		lock_release(ft->ft_lock);
+		return 0;
+	}
+
+	if ((unsigned)newfd >= fa->fa_size) {
+		result = fdtable_grow(ft, newfd + 1);
+		if (result) {
+			lock_release(ft->ft_lock);
+			return result;
+		}
+		fa = ft->ft_array;
+	}
+
+	fh_incref(fh);
+	prev = fa->fa_slots[newfd];
+	fdarray_set(fa, newfd, fh);
+	lock_release(ft->ft_lock);
+
+	if (prev != NULL) {
+		fh_decref(prev);
+	}
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include <thread.h>
 #include <kern/fcntl.h>
 #include <kern/stat.h>
+#include <kern/stattypes.h>
 #include <kern/seek.h>
 #include <types.h>
 #include <kern/errno.h>
@@ -20,62 +21,52 @@
 #include <uio.h>
 #include <proc.h>
 #include <syscall.h>
+#include <fdtable.h>
 #include <trapframe.h>
 #include <addrspace.h>
+#include <textcache.h>
 
 #define HEAP_MAX 0x40000000
 #include <spl.h>
 #include <kern/wait.h>
+#include <kern/spawn.h>
+#include <kern/mman.h>
 
+/*
+ * Open con: as fds 0, 1 and 2 in a fresh table for the current process.
+ */
 int initial_ftable(void){
-	struct vnode *vin, *vout, *verr;
-	char *stdin, *stdout, *stderr;
-	int result;
-	stdin = kstrdup("con:");
-	//stdin
-	result = vfs_open(stdin, O_RDONLY, 0664, &vin);
-	if(result){
-		kfree(stdin);
-		return result;
-	}
-	curthread->file_table[0] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
-	curthread->file_table[0]->flags = O_RDONLY;
-	curthread->file_table[0]->offset = 0;
-	curthread->file_table[0]->ref_count = 1;
-	curthread->file_table[0]->filelock = lock_create(stdin);
-	curthread->file_table[0]->vnode = vin;
-	
-	//stdout
-	stdout = kstrdup("con:");
-	result = vfs_open(stdout, O_WRONLY, 0664, &vout);
-	if(result){
-		kfree(stdin);
-		kfree(stdout); 
-		return result;
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct vnode *v;
+	struct file_handle *fh;
+	char path[5];
+	int i, fd, result;
+
+	if(curproc->p_fdtable == NULL){
+		curproc->p_fdtable = fdtable_create();
+		if(curproc->p_fdtable == NULL){
+			return ENOMEM;
+		}
 	}
-	curthread->file_table[1] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
-	curthread->file_table[1]->flags = O_WRONLY;
-	curthread->file_table[1]->offset = 0;
-	curthread->file_table[1]->ref_count = 1;
-	curthread->file_table[1]->filelock = lock_create(stdout);
-	curthread->file_table[1]->vnode = vout;
-
-	//stderr
-	stderr = kstrdup("con:");
-	result = vfs_open(stderr, O_WRONLY, 0664, &verr);
-	if(result){
-		kfree(stdin);
-		kfree(stdout); 
-		kfree(stderr);
-		return result;
 
+	for(i=0; i<3; i++){
+		strcpy(path, "con:");
+		result = vfs_open(path, modes[i], 0664, &v);
+		if(result){
+			return result;
+		}
+		result = fh_create(v, modes[i], 0, &fh);
+		if(result){
+			vfs_close(v);
+			return result;
+		}
+		result = fdtable_add(curproc->p_fdtable, fh, &fd);
+		if(result){
+			fh_decref(fh);
+			return result;
+		}
+		KASSERT(fd == i);
 	}
-	curthread->file_table[2] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
-	curthread->file_table[2]->flags = O_WRONLY;
-	curthread->file_table[2]->offset = 0;
-	curthread->file_table[2]->ref_count = 1;
-	curthread->file_table[2]->filelock = lock_create(stderr);
-	curthread->file_table[2]->vnode = verr;
 
 	return 0;
 }
@@ -83,13 +74,19 @@ int initial_ftable(void){
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval){
 	struct vnode* fileobject;
-	int fd = 3, result;
+	struct file_handle *fh;
+	off_t offset = 0;
+	int fd, result;
 	char *name = (char *) kmalloc(sizeof(char)*PATH_MAX);
 	size_t name_len;
 	
 	//Stat struct for getting the size of the file. (VOP_STAT)
 	struct stat file_stat;
 
+	if(name == NULL){
+		return ENOMEM;
+	}
+
 	result = copyinstr((const_userptr_t) filename, name, PATH_MAX, &name_len);
 	if(result) {
 		kprintf("FILE OPEN - copyinstr failed- %d\n",result);
@@ -98,50 +95,42 @@ int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval){
 	}
 
 	// Check for Flags.
-	//Not Done***********************************
 	if(!((flags & O_ACCMODE) == O_RDONLY || (flags & O_ACCMODE) == O_WRONLY || (flags & O_ACCMODE) == O_RDWR)){
-		return EINVAL;
-	}
-	
-
-	while (curthread->file_table[fd] != NULL ) {
-		fd++;
-	}
-
-	if(fd == OPEN_MAX) {
 		kfree(name);
-		return ENFILE;
+		return EINVAL;
 	}
 
-	curthread->file_table[fd] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
-	if(curthread->file_table[fd] == NULL)
-	{
-        	kfree(name);
-        	return ENFILE; 
-      	} 
-	  	
   	result = vfs_open(name, flags, mode, &fileobject);
+	kfree(name);
 	if(result){
-		kfree(name);
  		return result;
 	}
-	
-	curthread->file_table[fd]->flags = flags;
-	
-	if(flags==O_APPEND){
-		int stat_err = VOP_STAT(fileobject, &file_stat);
-		if(stat_err)
-			return stat_err;
-		curthread->file_table[fd]->offset = file_stat.st_size;
+
+	//Programs started from here on must not see a stale cached copy
+	if((flags & O_ACCMODE) != O_RDONLY){
+		textcache_invalidate(fileobject);
 	}
 	
-	else
-		curthread->file_table[fd]->offset = 0;
+	if(flags & O_APPEND){
+		result = VOP_STAT(fileobject, &file_stat);
+		if(result){
+			vfs_close(fileobject);
+			return result;
+		}
+		offset = file_stat.st_size;
+	}
 
+	result = fh_create(fileobject, flags, offset, &fh);
+	if(result){
+		vfs_close(fileobject);
+		return result;
+	}
 
-	curthread->file_table[fd]->ref_count = 1;
-	curthread->file_table[fd]->filelock=lock_create(name);
-	curthread->file_table[fd]->vnode = fileobject;
+	result = fdtable_add(curproc->p_fdtable, fh, &fd);
+	if(result){
+		fh_decref(fh);
+		return result;
+	}
 
 	*retval = fd;
 	return 0;
@@ -150,19 +139,11 @@ int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval){
 
 int sys_close(int fd, int *retval){
 	
-	if(fd>=OPEN_MAX || fd<0 || curthread->file_table[fd]==NULL){
-		return EBADF;
-	}
-
-	curthread->file_table[fd]->ref_count--;
-
-	if(curthread->file_table[fd]->ref_count == 0){
-
-		lock_destroy(curthread->file_table[fd]->filelock);
-		vfs_close(curthread->file_table[fd]->vnode);
-		kfree(curthread->file_table[fd]);
-		curthread->file_table[fd]=NULL;
+	int result;
 
+	result = fdtable_remove(curproc->p_fdtable, fd);
+	if(result){
+		return result;
 	}
 
 	*retval = 0;
@@ -170,128 +151,192 @@ int sys_close(int fd, int *retval){
 
 }
 
-int sys_read(int fd, void *buf, size_t buflen, int *retval){
-
-	struct iovec iov;
+/*
+ * Common code for read, write and their vectored and positional
+ * forms. IOV is a kernel copy of the caller's iovecs, still holding
+ * user pointers. If POSITIONAL is set the transfer happens at POS and
+ * the handle's shared offset is neither used nor updated, so the
+ * handle's lock isn't taken and parallel positional I/O on one file
+ * doesn't serialize here.
+ */
+static int file_rw(int fd, struct iovec *iov, int iovcnt, bool positional, off_t pos, enum uio_rw rw, int *retval){
+
+	struct file_handle *fh;
 	struct uio u;
-	void *mem_buf[buflen];
-	int result;
-
-	if(fd<0 || fd>OPEN_MAX || curthread->file_table[fd] == NULL || curthread->file_table[fd]->flags == O_WRONLY){
-
-		kprintf("Invalid File Descriptor\n");
-		return EBADF;
+	size_t total = 0;
+	int i, result;
+
+	/*
+	 * Only check that each range is in user space; uiomove copies
+	 * straight between it and the vnode (or buffer cache) and
+	 * catches unmapped pages itself.
+	 */
+	for(i=0; i<iovcnt; i++){
+		vaddr_t base = (vaddr_t)iov[i].iov_ubase;
+
+		if(iov[i].iov_len == 0){
+			continue;
+		}
+		if(base == 0 || base + iov[i].iov_len < base ||
+		   base + iov[i].iov_len > USERSPACETOP){
+			return EFAULT;
+		}
+		if(total + iov[i].iov_len < total){
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
 	}
 
-	result = copyin((const_userptr_t) buf, mem_buf, buflen);
+	result = fdtable_get(curproc->p_fdtable, fd, &fh);
 	if(result){
-		kprintf("In sys_read. Bad pointer...\n");
-		return EFAULT;
+		return result;
+	}
+	if((rw == UIO_READ && (fh->flags & O_ACCMODE) == O_WRONLY) ||
+	   (rw == UIO_WRITE && (fh->flags & O_ACCMODE) == O_RDONLY)){
+		fh_decref(fh);
+		return EBADF;
 	}
 
-	lock_acquire(curthread->file_table[fd]->filelock);
+	if(positional){
+		if(!VOP_ISSEEKABLE(fh->vnode)){
+			fh_decref(fh);
+			return ESPIPE;
+		}
+		if(pos < 0){
+			fh_decref(fh);
+			return EINVAL;
+		}
+	}
+	else{
+		lock_acquire(fh->filelock);
+		pos = fh->offset;
+	}
 
-	iov.iov_ubase = (userptr_t) buf;
-	iov.iov_len = buflen;
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_offset = curthread->file_table[fd]->offset;
-	u.uio_resid = buflen;
-	u.uio_rw = UIO_READ;
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_offset = pos;
+	u.uio_resid = total;
+	u.uio_rw = rw;
 	u.uio_segflg = UIO_USERSPACE;
-	u.uio_space = curthread->t_proc->p_addrspace;	
+	u.uio_space = curthread->t_proc->p_addrspace;
 
-	result = VOP_READ(curthread->file_table[fd]->vnode, &u);
-	if(result){
-		kprintf("Error during read\n");
-		lock_release(curthread->file_table[fd]->filelock);
-		return EIO;
+	if(rw == UIO_READ){
+		result = VOP_READ(fh->vnode, &u);
+	}
+	else{
+		result = VOP_WRITE(fh->vnode, &u);
+		textcache_invalidate(fh->vnode);
 	}
 
-	*retval = buflen-u.uio_resid;
-	curthread->file_table[fd]->offset = u.uio_offset;
+	if(!positional){
+		if(result == 0){
+			fh->offset = u.uio_offset;
+		}
+		lock_release(fh->filelock);
+	}
+	fh_decref(fh);
+	if(result){
+		return result;
+	}
 
-	lock_release(curthread->file_table[fd]->filelock);
+	*retval = total - u.uio_resid;
 	return 0;
+}
+
+/*
+ * Copy in a user iovec array for the vectored calls.
+ */
+static int file_rwv(int fd, const_userptr_t useriov, int iovcnt, bool positional, off_t pos, enum uio_rw rw, int *retval){
+
+	struct iovec *iov;
+	int result;
+
+	if(iovcnt <= 0 || iovcnt > IOV_MAX){
+		return EINVAL;
+	}
 
+	iov = kmalloc(sizeof(struct iovec)*iovcnt);
+	if(iov == NULL){
+		return ENOMEM;
+	}
+	result = copyin(useriov, iov, sizeof(struct iovec)*iovcnt);
+	if(result == 0){
+		result = file_rw(fd, iov, iovcnt, positional, pos, rw, retval);
+	}
+	kfree(iov);
+	return result;
+}
+
+int sys_read(int fd, void *buf, size_t buflen, int *retval){
+
+	struct iovec iov;
+
+	iov.iov_ubase = (userptr_t) buf;
+	iov.iov_len = buflen;
+	return file_rw(fd, &iov, 1, false, 0, UIO_READ, retval);
 }
 
 int sys_write(int fd, const void *buf, size_t nbytes, int *retval){
 
 	struct iovec iov;
-	struct uio u;
-	// void *mem_buf[nbytes];
-	int result;
 
-	if(fd<0 || fd>OPEN_MAX || curthread->file_table[fd] == NULL || curthread->file_table[fd]->flags == O_RDONLY){
+	iov.iov_ubase = (userptr_t) buf;
+	iov.iov_len = nbytes;
+	return file_rw(fd, &iov, 1, false, 0, UIO_WRITE, retval);
+}
 
-		kprintf("in sys_write.................\n");
-		kprintf("Invalid File Descriptor\n");
-		return EBADF;
-	}
+int sys_pread(int fd, void *buf, size_t buflen, off_t pos, int *retval){
 
-	// result = copyin((const_userptr_t) buf, mem_buf, nbytes);
-	// if(result){
-	// 	kprintf("In sys_write. Bad pointer...\n");
-	// 	return EFAULT;
-	// }
+	struct iovec iov;
 
-	//ENOSPC condition
+	iov.iov_ubase = (userptr_t) buf;
+	iov.iov_len = buflen;
+	return file_rw(fd, &iov, 1, true, pos, UIO_READ, retval);
+}
 
-	lock_acquire(curthread->file_table[fd]->filelock);
+int sys_pwrite(int fd, const void *buf, size_t nbytes, off_t pos, int *retval){
+
+	struct iovec iov;
 
-	//uio_kinit(&iov, &u, (void *) buf, nbytes, curthread->file_table[fd]->offset, UIO_WRITE);
 	iov.iov_ubase = (userptr_t) buf;
 	iov.iov_len = nbytes;
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_offset = curthread->file_table[fd]->offset;
-	u.uio_resid = nbytes;
-	u.uio_rw = UIO_WRITE;
-	u.uio_segflg = UIO_USERSPACE;
-	u.uio_space = curthread->t_proc->p_addrspace;	
-
-	// if(curthread->file_table[fd]->vnode == NULL){
-	// 	panic("Null pointer in sys_write......\n");
-	// 	return -1;
-	// }
-	// if(curthread->file_table[fd]->vnode->vn_ops == NULL){
-	// 	panic("VN_OPS is null for vnode object....\n");
-	// 	return -1;
-	// }
-
-	result = VOP_WRITE(curthread->file_table[fd]->vnode, &u);
-	if(result){
-		kprintf("Error during write\n");
-		lock_release(curthread->file_table[fd]->filelock);
-		return EIO;
-	}
+	return file_rw(fd, &iov, 1, true, pos, UIO_WRITE, retval);
+}
 
-	*retval = nbytes-u.uio_resid;
-	curthread->file_table[fd]->offset = u.uio_offset;
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval){
+	return file_rwv(fd, iov, iovcnt, false, 0, UIO_READ, retval);
+}
 
-	lock_release(curthread->file_table[fd]->filelock);
-	return 0;
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval){
+	return file_rwv(fd, iov, iovcnt, false, 0, UIO_WRITE, retval);
 }
 
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval){
+	return file_rwv(fd, iov, iovcnt, true, pos, UIO_READ, retval);
+}
+
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval){
+	return file_rwv(fd, iov, iovcnt, true, pos, UIO_WRITE, retval);
+}
 
 int sys_lseek(int fd, off_t pos, int whence, off_t *retval_high){
 
+	struct file_handle *fh;
 	off_t new_pos;
 	struct stat file_stat;
-	int stat_err;
+	int result;
 
-	if(fd<0 || fd>OPEN_MAX || curthread->file_table[fd] == NULL){
-		kprintf("Invalid File Descriptor\n");
-		return EBADF;
+	result = fdtable_get(curproc->p_fdtable, fd, &fh);
+	if(result){
+		return result;
 	}
 
-	if(!(VOP_ISSEEKABLE(curthread->file_table[fd]->vnode))){
-		kprintf("Seek not allowed on this file..\n");
+	if(!(VOP_ISSEEKABLE(fh->vnode))){
+		fh_decref(fh);
 		return ESPIPE;
 	}
 
-	lock_acquire(curthread->file_table[fd]->filelock);
+	lock_acquire(fh->filelock);
 
 	switch(whence){
 		
@@ -300,42 +345,36 @@ int sys_lseek(int fd, off_t pos, int whence, off_t *retval_high){
 		break;
 
 		case SEEK_CUR:
-		new_pos = curthread->file_table[fd]->offset+pos;
+		new_pos = fh->offset+pos;
 		break;
 
 		case SEEK_END:
-		stat_err = VOP_STAT(curthread->file_table[fd]->vnode, &file_stat);
-		if(stat_err){
-			lock_release(curthread->file_table[fd]->filelock);
-			return stat_err;
+		result = VOP_STAT(fh->vnode, &file_stat);
+		if(result){
+			lock_release(fh->filelock);
+			fh_decref(fh);
+			return result;
 		}
 		new_pos = file_stat.st_size + pos;
 		break;
 
 		default:
-		kprintf("WHENCE is invalid\n");
-		lock_release(curthread->file_table[fd]->filelock);
+		lock_release(fh->filelock);
+		fh_decref(fh);
 		return EINVAL;
 
 	}
 
 	if(new_pos<0){
-		kprintf("Resulting seek value is negative\n");
-		lock_release(curthread->file_table[fd]->filelock);
+		lock_release(fh->filelock);
+		fh_decref(fh);
 		return EINVAL;
 	}
 
-	// int result = VOP_TRYSEEK(curthread->file_table[fd]->vnode, new_pos);
-	// if(result){
-	// 	kprintf("Error During VOP_TRYSEEK\n");
-	// 	lock_release(curthread->file_table[fd]->filelock);
-	// 	return result;
-
-	// }
-
-	curthread->file_table[fd]->offset = new_pos;
+	fh->offset = new_pos;
 	*retval_high = new_pos;
-	lock_release(curthread->file_table[fd]->filelock);
+	lock_release(fh->filelock);
+	fh_decref(fh);
 
 	return 0;
 }
@@ -392,31 +431,10 @@ int sys_dup2(int oldfd, int newfd, int *retval){
 
 	int result;
 
-	if(oldfd < 0 || newfd < 0 ){
-		return EBADF;
-	}
-
-	if(oldfd > OPEN_MAX || newfd > OPEN_MAX){
-		return  EMFILE;
-	}
-
-	lock_acquire(curthread->file_table[oldfd]->filelock);
-
-	if(curthread->file_table[newfd] != NULL) {
-		result = sys_close(newfd, retval);
-		if(result) {
-			kprintf("dup2 - sys_close failed!!\n");
-			return -1;
-		}
-	}
-	else {
-		curthread->file_table[newfd] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
+	result = fdtable_dup2(curproc->p_fdtable, oldfd, newfd);
+	if(result){
+		return result;
 	}
-	curthread->file_table[newfd]->flags = curthread->file_table[oldfd]->flags;
-	curthread->file_table[newfd]->offset = curthread->file_table[oldfd]->offset;
-	curthread->file_table[newfd]->ref_count = curthread->file_table[oldfd]->ref_count;
-	curthread->file_table[newfd]->filelock = curthread->file_table[oldfd]->filelock;
-	curthread->file_table[newfd]->vnode = curthread->file_table[oldfd]->vnode;
 
 	*retval = newfd;
 	return 0;
@@ -438,19 +456,8 @@ pid_t sys_fork(struct trapframe *parent_tf, int *retval){
 	}
 	
 
-	lock_acquire(proc_lock);
-	child_proc->p_cwd = curproc->p_cwd;
-	pid_t c_pid = givepid();
-	if(c_pid == -1){
-		lock_release(proc_lock);
-		return ENOMEM;
-	}
-	child_proc->ppid = curproc->pid;
-	child_proc->pid = c_pid;
-	proc_table[c_pid] = child_proc;
-	// kprintf("created new process : %d\n", c_pid);
-	lock_release(proc_lock);
 	child_proc->p_cwd = curproc->p_cwd;
+	pid_t c_pid = child_proc->pid;
 
 	// struct addrspace *child_addrspace;
 
@@ -458,12 +465,21 @@ pid_t sys_fork(struct trapframe *parent_tf, int *retval){
 	result = as_copy(curproc->p_addrspace, &(child_proc->p_addrspace));
 
 	if(result){
-		return ENOMEM;
+		proc_destroy(child_proc);
+		return result;
+	}
+
+	// The child shares the parent's open files, offsets included.
+	result = fdtable_copy(curproc->p_fdtable, &child_proc->p_fdtable);
+	if(result){
+		proc_destroy(child_proc);
+		return result;
 	}
 
 	struct trapframe *child_tf = kmalloc(sizeof(struct trapframe));
 
 	if(child_tf == NULL){
+		proc_destroy(child_proc);
 		return ENOMEM;
 	}
 
@@ -471,10 +487,14 @@ pid_t sys_fork(struct trapframe *parent_tf, int *retval){
 
 	// result = thread_fork("Child Thread", child_proc, entrypoint, (struct trapframe *) child_tf, (unsigned long) child_addrspace);
 	// result = thread_fork("Child Thread", child_proc, entrypoint, (struct trapframe *) child_tf, (unsigned long) (child_proc->p_addrspace));
+	proc_addchild(curproc, child_proc);
 	result = thread_fork("Child Thread", child_proc, entrypoint, (struct trapframe *) child_tf, (unsigned long) curproc->pid);
 
 	if(result){
-		return ENOMEM;
+		kfree(child_tf);
+		proc_remchild(child_proc);
+		proc_destroy(child_proc);
+		return result;
 	}
 
 	*retval = c_pid;
@@ -499,8 +519,8 @@ void entrypoint(void* data1, unsigned long data2) {
 		as_activate();
 	}
 	
-	if(proc_table[curproc->pid]->ppid!= (pid_t)data2){
-        proc_table[curproc->pid]->ppid = (pid_t)data2;
+	if(curproc->ppid != (pid_t)data2){
+        curproc->ppid = (pid_t)data2;
     }
 
 	new_tf = *tf;
@@ -509,116 +529,110 @@ void entrypoint(void* data1, unsigned long data2) {
 
 void sys_exit(int exitcode){
 
-	curproc->exitcode = _MKWAIT_EXIT(exitcode);
-	curproc->exited = true;
-	//kprintf("Was able to set the exitcode...\n");
-	// splhigh();
-	// V(proc_table[j]->exitsem);
-	V(curproc->exitsem);
-	thread_exit();
-	proc_destroy(curproc);
-}
-
-pid_t sys_waitpid(pid_t pid, int *status, int options, int *retval, bool is_kernel){
-	// int result;
-
-	if(options != 0){
-		return EINVAL;
-	}
-
-	if(status == NULL){
-		return EFAULT;
-	}
-
-	if(pid < PID_MIN){
-		return EINVAL;
-	}
+	struct proc *proc = curproc;
+	struct addrspace *as;
+	int result;
 
-	if(pid > MAX_PROC){
-		return ESRCH;
+	if(proc->p_fdtable != NULL){
+		fdtable_destroy(proc->p_fdtable);
+		proc->p_fdtable = NULL;
 	}
 
-	if(pid == curproc->pid){
-		return ECHILD;
+	as = proc_setas(NULL);
+	as_deactivate();
+	if(as != NULL){
+		as_destroy(as);
 	}
 
-	if(pid == curproc->ppid){
-		return ECHILD;
-	}
+	/*
+	 * Finish running on the kernel process, so this one has no
+	 * threads left and whoever reaps it can free it right away.
+	 */
+	proc_remthread(curthread);
+	result = proc_addthread(kproc, curthread);
+	KASSERT(result == 0);
 
-	// for(demo=proc_table; demo->pid != pid || demo == NULL; demo=demo->next);
+	proc_exited(proc, _MKWAIT_EXIT(exitcode));
+	thread_exit();
+}
 
-// <<<<<<< HEAD
-	// pid_t i;
-	// for(i=PID_MIN; i<MAX_PROC; i++){
-	// 	if(i==pid){
-	// 		kprintf("In WAITPID. Found my child's PID: %d ", i);
-	// 		break;
-	// 	}
-	// }
+/*
+ * Wait for a child to exit. PID may be a specific child, or -1 for
+ * whichever child exits first. With WNOHANG, return 0 instead of
+ * sleeping if no such child has exited yet. If IS_KERNEL, STATUS is a
+ * kernel pointer.
+ */
+pid_t sys_waitpid(pid_t pid, int *status, int options, int *retval, bool is_kernel){
 
+	struct proc *self = curproc, *child;
+	int exitcode, result;
 
-	if(proc_table[pid] == NULL){
-		return ESRCH;
+	if(options & ~WNOHANG){
+		return EINVAL;
 	}
-
-	if(proc_table[pid]->ppid != curproc->pid){
-		return ECHILD;
+	if(pid != -1 && (pid < PID_MIN || pid > PROC_MAXPID)){
+		return ESRCH;
 	}
 
-// <<<<<<< HEAD
-	if(proc_table[pid]->exited == false){
-		P(proc_table[pid]->exitsem);
-		//kprintf("In WaitPID. Got P for PID: %d", pid);
-
+	lock_acquire(proc_lock);
+	while(1){
+		if(pid == -1){
+			if(self->p_children.pl_head == NULL && self->p_zombies.pl_head == NULL){
+				lock_release(proc_lock);
+				return ECHILD;
+			}
+			child = self->p_zombies.pl_head;
+		}
+		else{
+			child = proc_lookup(pid);
+			if(child == NULL){
+				lock_release(proc_lock);
+				return ESRCH;
+			}
+			if(child->p_parent != self){
+				lock_release(proc_lock);
+				return ECHILD;
+			}
+			if(!child->exited){
+				child = NULL;
+			}
+		}
+		if(child != NULL){
+			break;
+		}
+		if(options & WNOHANG){
+			lock_release(proc_lock);
+			*retval = 0;
+			return 0;
+		}
+		cv_wait(self->p_waitcv, proc_lock);
 	}
+	exitcode = child->exitcode;
+	pid = child->pid;
+	lock_release(proc_lock);
 
-	if(is_kernel == false){
-		copyout((void*)&(proc_table[pid]->exitcode), (userptr_t) status, sizeof(int));	
-	} else {
-		status = &(proc_table[pid]->exitcode);
+	/*
+	 * Nobody else reaps our children, so the zombie stays put while
+	 * we copy out; if that fails it's still there to wait for.
+	 */
+	if(status != NULL){
+		if(is_kernel){
+			*status = exitcode;
+		}
+		else{
+			result = copyout(&exitcode, (userptr_t) status, sizeof(int));
+			if(result){
+				return result;
+			}
+		}
 	}
-	// result = copyout((void*)&(proc_table[i]->exitcode), (userptr_t) status, sizeof(int));
 
-	// if(result){
-	// 	return EFAULT;
-	// }
+	proc_reap(child);
 
 	*retval = pid;
-// <<<<<<< HEAD
-	// kprintf("Destroying PROC now......\n");
-
-	//proc_destroy(proc_table[i]);
-
-	// sem_destroy(proc_table[i]->exitsem);
-	// //spinlock_cleanup(*(proc_table[i]->p_lock));
-	// kprintf("Everything good. freeing..\n");
-	// kfree(proc_table[i]->p_name);
-	// kfree(proc_table[i]);
-
-
-	remove_pid(pid);
-
 	return 0;
 }
 
-void remove_pid(pid_t pid){
-    if(proc_table[pid]!= NULL){
-        // if((proc_table[pid]->ppid) > PID_MIN){
-        //     int i =0 ;
-        //     for(i=3; i<OPEN_MAX;i++){
-        //         if(curthread->file_table[i]!=NULL){
-        //             proc_table[proc_table[pid]->ppid]->file_table[i]->refcount--;
-        //     	}
-        // 	}
-        // }
-        //sem_destroy(process_table[pid]->exitsem);
-        //lock_destroy(process_table[pid]->p_lock);
-        kfree(proc_table[pid]);
-        proc_table[pid] = NULL;
-    }
-}
-
 int sbrk(intptr_t amount, int *retval){
 	struct addrspace *as = proc_getas();
 
@@ -637,7 +651,9 @@ int sbrk(intptr_t amount, int *retval){
     }
     else{
     	
-    	if ((as->heap_end+amount) < (USERSTACK-STACKPAGES * PAGE_SIZE) && (as->heap_end+amount) < (as->heap_start+HEAP_MAX)) {
+    	//Also stop short of any mmap region in the way
+    	if ((as->heap_end+amount) < (USERSTACK-STACKPAGES * PAGE_SIZE) && (as->heap_end+amount) < (as->heap_start+HEAP_MAX) &&
+    	    !as_overlaps(as, as->heap_end & PAGE_FRAME, DIVROUNDUP(as->heap_end+amount, PAGE_SIZE) - as->heap_end/PAGE_SIZE)) {
         *retval = as->heap_end;
         as->heap_end += amount;
         return 0;
@@ -649,254 +665,494 @@ int sbrk(intptr_t amount, int *retval){
     //return 0;
 }
 
+/*
+ * Map a file, or anonymous zero-filled memory. ADDR is only a hint,
+ * and we don't take it. Nothing is read here; the pages come in
+ * through vm_fault as they are touched. There is no page cache for
+ * files, so MAP_SHARED means stores reach the file (on munmap, fsync,
+ * exit, or when the page is evicted), and is shared with children
+ * for pages already resident at fork; other processes mapping the
+ * file see the changes once they're written back. For the same reason
+ * a shared anonymous mapping would have nothing to share through, and
+ * isn't supported.
+ */
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd, off_t offset, int *retval){
+
+	struct file_handle *fh = NULL;
+	struct vnode *vn = NULL;
+	struct stat st;
+	size_t filesz = 0;
+	vaddr_t base;
+	int type, result;
+
+	(void)addr;
+
+	type = flags & (MAP_SHARED | MAP_PRIVATE);
+	if(len == 0 || (type != MAP_SHARED && type != MAP_PRIVATE) ||
+	   (flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANON)) ||
+	   (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))){
+		return EINVAL;
+	}
+	if(len > USERSPACETOP){
+		return ENOMEM;
+	}
 
-int sys_execv(userptr_t program, char** user_args){
+	if(flags & MAP_ANON){
+		if(type == MAP_SHARED){
+			return EINVAL;
+		}
+		offset = 0;
+	}
+	else{
+		if(offset < 0 || offset % PAGE_SIZE != 0){
+			return EINVAL;
+		}
+		result = fdtable_get(curproc->p_fdtable, fd, &fh);
+		if(result){
+			return result;
+		}
+		vn = fh->vnode;
 
+		//Stores to a shared mapping are writes to the file
+		if((fh->flags & O_ACCMODE) == O_WRONLY ||
+		   (type == MAP_SHARED && (prot & PROT_WRITE) && (fh->flags & O_ACCMODE) != O_RDWR)){
+			fh_decref(fh);
+			return EACCES;
+		}
+		result = VOP_STAT(vn, &st);
+		if(result){
+			fh_decref(fh);
+			return result;
+		}
+		if((st.st_mode & _S_IFMT) != _S_IFREG){
+			fh_decref(fh);
+			return ENODEV;
+		}
+		if(st.st_size > offset){
+			filesz = st.st_size - offset < (off_t)len ? st.st_size - offset : len;
+		}
+	}
 
-	int res, length, i = 0, segment = 0;
-	struct lock *exec_lock = lock_create("Lock for Execv");
-	struct vnode *vnode;
-	vaddr_t entrypoint, stackptr;
+	//The region holds its own reference to the vnode
+	result = as_mmap(proc_getas(), DIVROUNDUP(len, PAGE_SIZE), prot, type == MAP_SHARED ? REG_SHARED : 0, vn, offset, filesz, &base);
+	if(fh != NULL){
+		fh_decref(fh);
+	}
+	if(result){
+		return result;
+	}
 
-	lock_acquire(exec_lock);
+	*retval = base;
+	return 0;
+}
 
-	//char **args = (char **) user_args;
+int sys_munmap(userptr_t addr, size_t len, int *retval){
 
-	if(program == NULL){
-		return EFAULT;
+	vaddr_t base = (vaddr_t)addr;
+	int result;
+
+	if(len == 0 || (base & ~PAGE_FRAME) != 0 ||
+	   base + len < base || base + len > USERSPACETOP){
+		return EINVAL;
 	}
 
-	//Copy and check the Program name...
-	char *progname;
-	size_t size;
+	result = as_munmap(proc_getas(), base, DIVROUNDUP(len, PAGE_SIZE));
+	if(result){
+		return result;
+	}
 
-	progname = (char *) kmalloc(sizeof(char)*NAME_MAX);
-	if(progname == NULL){
-		lock_release(exec_lock);
-		return ENOMEM;
+	*retval = 0;
+	return 0;
+}
+
+/*
+ * Flush our shared mappings of the file first, so that what reaches
+ * the disk includes stores made through them.
+ */
+int sys_fsync(int fd, int *retval){
+
+	struct file_handle *fh;
+	int result;
+
+	result = fdtable_get(curproc->p_fdtable, fd, &fh);
+	if(result){
+		return result;
 	}
-	res = copyinstr((const_userptr_t) program, progname, NAME_MAX, &size);
 
-	if(res){
-		lock_release(exec_lock);
-		kfree(progname);
-		kprintf("EXECV. Failed to copyin progname\n");
-		return EFAULT;
+	result = as_sync(proc_getas(), fh->vnode);
+	if(result == 0){
+		result = VOP_FSYNC(fh->vnode);
+	}
+	fh_decref(fh);
+	if(result){
+		return result;
 	}
 
-	//Determine length(no. of arguments) of user_args
-	length = 0;
-	while(user_args[length] != NULL){
-        length++;
-    }
-    //kprintf("EXECV. %d arguments passed.\n", length);
+	*retval = 0;
+	return 0;
+}
 
-	//Copy and check arguments...
 
-	char **arguments = (char **) kmalloc(sizeof(char **)*length);
-	if(arguments == NULL){
-		lock_release(exec_lock);
-		kfree(progname);
-		kprintf("EXECV. Failed to create arguments buffer\n");
-		return ENOMEM;
-	}
+/*
+ * Argument staging for execv.
+ *
+ * The strings are copied in exactly once, straight into a single
+ * ARG_MAX-sized, page-backed block. Each one is NUL-padded to a
+ * multiple of 4, and the argv array is then built right after the
+ * strings, with pointers relative to where the block will land on the
+ * new user stack. The finished block goes out in one copyout. Strings
+ * plus pointers (including the terminating NULL) must fit in ARG_MAX,
+ * or we fail with E2BIG.
+ */
+#define EXEC_ARGPAGES	(ARG_MAX / PAGE_SIZE)
 
-	res = copyin((const_userptr_t) user_args, arguments, (sizeof(char *)*length));
-	if(res){
-		kprintf("EXECV. Failed to copyin args pointers.\n");
-		lock_release(exec_lock);
-		kfree(progname);
-		kfree(arguments);
+static int exec_packargs(userptr_t user_args, char *buf, int *argc_ret, size_t *strlen_ret){
+
+	userptr_t uarg;
+	size_t used = 0, got, room;
+	int argc = 0, result;
+
+	if(user_args == NULL){
 		return EFAULT;
 	}
 
-	//Declaring individual strings
+	while(1){
+		result = copyin((const_userptr_t)user_args + argc*sizeof(userptr_t), &uarg, sizeof(uarg));
+		if(result){
+			return result;
+		}
+		if(uarg == NULL){
+			break;
+		}
 
-	size_t chunk[length];
-	while(i < length){
+		/* Leave room for this pointer, the NULL, and one more byte. */
+		if(used + (argc+2)*sizeof(userptr_t) >= ARG_MAX){
+			return E2BIG;
+		}
+		room = ARG_MAX - used - (argc+2)*sizeof(userptr_t);
 
-		char *temp = (char *)kmalloc(ARG_MAX);
-		res = copyinstr((const_userptr_t)user_args[i], temp, PAGE_SIZE, &chunk[i]);
-        if (res){
-        	kprintf("EXECV. Failed to copyin argument strings. For temp.\n");
-			lock_release(exec_lock);
-			kfree(progname);
-			kfree(arguments);
-			//kfree(u_args);
-			return EFAULT;
-	        }
-	    //kprintf("Done copying the string. For size.. \n");
-	    i++;
-	    kfree(temp);
+		result = copyinstr((const_userptr_t)uarg, buf + used, room, &got);
+		if(result == ENAMETOOLONG){
+			return E2BIG;
+		}
+		if(result){
+			return result;
+		}
+		used += got;
+		while(used % sizeof(userptr_t) != 0){
+			if(used + (argc+2)*sizeof(userptr_t) >= ARG_MAX){
+				return E2BIG;
+			}
+			buf[used++] = '\0';
+		}
+		argc++;
 	}
- 
 
-	//Copy to kernel buffer and pad to the nearest 4....
-	size_t pad;
+	*argc_ret = argc;
+	*strlen_ret = used;
+	return 0;
+}
 
-	i = 0;
- 	while (user_args[i] != NULL){
+/*
+ * Fill in the argv array after the packed strings, for a block that
+ * will be copied out to user address BASE.
+ */
+static void exec_buildargv(char *buf, int argc, size_t strbytes, vaddr_t base){
 
-        arguments[i] = (char *)kmalloc(sizeof(char)*chunk[i]);
-        res = copyinstr((const_userptr_t)user_args[i], arguments[i], chunk[i], &chunk[i]);
-        if (res){
-        	kprintf("EXECV. Failed to copyin argument strings\n");
-			lock_release(exec_lock);
-			kfree(progname);
-			kfree(arguments);
-			//kfree(u_args);
-			return EFAULT;
-	        }
-	        //kprintf("Done copying the strings. \n");
-	        i++;
-	    }
+	userptr_t *argv = (userptr_t *)(buf + strbytes);
+	size_t off = 0;
+	int i;
+
+	for(i=0; i<argc; i++){
+		argv[i] = (userptr_t)(base + off);
+		off += strlen(buf + off) + 1;
+		off = ROUNDUP(off, sizeof(userptr_t));
+	}
+	argv[argc] = NULL;
+	KASSERT(off == strbytes);
+}
 
+int sys_execv(userptr_t program, char** user_args){
+
+	struct vnode *vnode;
+	struct addrspace *old_as, *new_as;
+	vaddr_t entrypoint, stackptr, argbase;
+	char *progname, *argbuf;
+	size_t size, strbytes, blockbytes;
+	int argc, res;
+
+	if(program == NULL){
+		return EFAULT;
+	}
 
-    arguments[i] = NULL;
+	progname = kmalloc(PATH_MAX);
+	if(progname == NULL){
+		return ENOMEM;
+	}
+	res = copyinstr((const_userptr_t) program, progname, PATH_MAX, &size);
+	if(res){
+		kfree(progname);
+		return res;
+	}
 
+	argbuf = (char *)alloc_kpages(EXEC_ARGPAGES);
+	if(argbuf == NULL){
+		kfree(progname);
+		return ENOMEM;
+	}
+	res = exec_packargs((userptr_t)user_args, argbuf, &argc, &strbytes);
+	if(res){
+		free_kpages((vaddr_t)argbuf);
+		kfree(progname);
+		return res;
+	}
+	blockbytes = strbytes + (argc+1)*sizeof(userptr_t);
 
 	//Arguments ok. Open File now
 	res = vfs_open(progname, O_RDONLY, 0, &vnode);
+	kfree(progname);
 	if(res) {
-		kprintf("EXECV. Failed to open file\n");
-		lock_release(exec_lock);
-		kfree(progname);
-		kfree(arguments);
-		//kfree(u_args);
+		free_kpages((vaddr_t)argbuf);
 		return res;
 	}
 
-	as_destroy(curproc->p_addrspace);
-    curproc->p_addrspace = NULL;
+	/*
+	 * Build the new image in a fresh address space, keeping the old
+	 * one until the load succeeds so a failed exec can still return.
+	 */
+	new_as = as_create();
+	if (new_as == NULL){
+		free_kpages((vaddr_t)argbuf);
+		vfs_close(vnode);
+		return ENOMEM;
+	}
+	old_as = proc_setas(new_as);
+	as_activate();
 
-    KASSERT(proc_getas() == NULL);
+	res = load_elf(vnode, &entrypoint);
+	vfs_close(vnode);
+	if(res == 0){
+		res = as_define_stack(new_as, &stackptr);
+	}
+	if(res == 0){
+		/* Keep the stack pointer 8-byte aligned. */
+		argbase = (stackptr - blockbytes) & ~(vaddr_t)7;
+		exec_buildargv(argbuf, argc, strbytes, argbase);
+		res = copyout(argbuf, (userptr_t)argbase, blockbytes);
+	}
+	free_kpages((vaddr_t)argbuf);
+	if(res){
+		proc_setas(old_as);
+		as_activate();
+		as_destroy(new_as);
+		return res;
+	}
 
+	if(old_as != NULL){
+		as_destroy(old_as);
+	}
 
-	//Create new AddrSpace and load it
-	struct addrspace *new_addr = as_create();
-    if (new_addr == NULL){
-    	kprintf("EXECV. Failed to create new addrspace\n");
-        lock_release(exec_lock);
-		kfree(progname);
-		kfree(arguments);
-		//kfree(u_args);
-		vfs_close(vnode);
-		return ENOMEM;
-    }
-    proc_setas(new_addr);
-    as_activate();
+	enter_new_process(argc, (userptr_t)(argbase + strbytes), NULL, argbase, entrypoint);
+	panic("panic enter_new_process returned\n");
+	return EINVAL;
+}
+
+/*
+ * Where a spawned child starts running, handed from sys_spawn to
+ * spawn_entry.
+ */
+struct spawn_start {
+	int ss_argc;
+	vaddr_t ss_argv;
+	vaddr_t ss_stack;
+	vaddr_t ss_entry;
+};
+
+static void spawn_entry(void *data1, unsigned long data2){
+
+	struct spawn_start start = *(struct spawn_start *)data1;
+
+	(void)data2;
+	kfree(data1);
 
+	as_activate();
+	enter_new_process(start.ss_argc, (userptr_t)start.ss_argv, NULL, start.ss_stack, start.ss_entry);
+	panic("panic enter_new_process returned\n");
+}
+
+/*
+ * Load PROGNAME into a new address space for a child, switching the
+ * current process to it just for the load; the caller's image is put
+ * back before returning. On success the new space, with the packed
+ * arguments already on its stack, is returned in AS_RET.
+ */
+static int spawn_load(struct vnode *vnode, char *argbuf, int argc, size_t strbytes, struct addrspace **as_ret, struct spawn_start *start){
+
+	struct addrspace *old_as, *new_as;
+	vaddr_t entrypoint, stackptr, argbase;
+	size_t blockbytes;
+	int res;
+
+	new_as = as_create();
+	if(new_as == NULL){
+		return ENOMEM;
+	}
+	old_as = proc_setas(new_as);
+	as_activate();
 
 	res = load_elf(vnode, &entrypoint);
+	if(res == 0){
+		res = as_define_stack(new_as, &stackptr);
+	}
+	if(res == 0){
+		blockbytes = strbytes + (argc+1)*sizeof(userptr_t);
+		argbase = (stackptr - blockbytes) & ~(vaddr_t)7;
+		exec_buildargv(argbuf, argc, strbytes, argbase);
+		res = copyout(argbuf, (userptr_t)argbase, blockbytes);
+	}
+
+	proc_setas(old_as);
+	as_activate();
 	if(res){
-		kprintf("EXECV. Failed to load_elf\n");
-		lock_release(exec_lock);
-		kfree(progname);
-		kfree(arguments);
-		//kfree(u_args);
-		vfs_close(vnode);
-		//curproc->p_addrspace = temporary;
+		as_destroy(new_as);
 		return res;
 	}
 
- 	res = as_define_stack(curproc->p_addrspace, &stackptr);	
- 	if(res){
- 		kprintf("EXECV. Failed to as_define_stack\n");
-		lock_release(exec_lock);
-		kfree(progname);
-		kfree(arguments);
-		//kfree(u_args);
-		vfs_close(vnode);
-		//curproc->p_addrspace = temporary;
+	start->ss_argc = argc;
+	start->ss_argv = argbase + strbytes;
+	start->ss_stack = argbase;
+	start->ss_entry = entrypoint;
+	*as_ret = new_as;
+	return 0;
+}
+
+/*
+ * Create a child running PROGRAM with USER_ARGS, without copying the
+ * caller's address space the way fork+execv would. The child gets a
+ * copy of the caller's descriptor table with NACTIONS file actions
+ * applied to it.
+ */
+int sys_spawn(userptr_t program, userptr_t user_args, const_userptr_t user_actions, int nactions, int *retval){
+
+	struct spawn_action *actions = NULL;
+	struct spawn_start *start;
+	struct proc *child_proc;
+	struct vnode *vnode;
+	char *progname, *argbuf;
+	size_t size, strbytes;
+	int argc, i, res;
 
+	if(program == NULL){
+		return EFAULT;
+	}
+	if(nactions < 0 || nactions > SPAWN_MAXACTIONS){
+		return EINVAL;
+	}
+
+	progname = kmalloc(PATH_MAX);
+	if(progname == NULL){
+		return ENOMEM;
+	}
+	res = copyinstr((const_userptr_t) program, progname, PATH_MAX, &size);
+	if(res){
+		kfree(progname);
 		return res;
 	}
 
-////////////////////////////////////////////////////////////////////
-	//char ** newpointer = kmalloc(sizeof(char *)*length);
-	while(segment < length){
-		//length = strlen(arguments[segment]);
-		pad = 0;
-		if(chunk[segment]%4 != 0){
-	    	pad = 4 - (chunk[segment]%4);
-	    }
-	    //arg = u_args[i];
-	    size_t newlength = chunk[segment]+pad;
-	    
-	    //kprintf("Value in arguments array is: %s\n", arguments[segment]);
-
-  	    char *arg = kmalloc(sizeof(char)*newlength);
-
-	    //char *arg = kstrdup(arguments[segment]);
-
-	    for(size_t j = 0; j<newlength; j++){
-	    	//arg[j] = '\0';
-	    	if(j < chunk[segment]){
-	    		arg[j] = arguments[segment][j]; 
-	    	}
-	    	else{
-	    		arg[j] = '\0';
-	    	} 	
-	    }
-	    //kprintf("String after padding is: %s\n", arg);
-
-		stackptr = stackptr - newlength;
-		//arguments[segment] = (char *)stackptr;
-
-		res = copyout((const void *) arg, (userptr_t) stackptr, (size_t) newlength);
+	if(nactions > 0){
+		actions = kmalloc(nactions*sizeof(*actions));
+		if(actions == NULL){
+			kfree(progname);
+			return ENOMEM;
+		}
+		res = copyin(user_actions, actions, nactions*sizeof(*actions));
 		if(res){
-			kprintf("EXECV. Failed to copyout argument strings. Stack is: %x\n", stackptr);
-			lock_release(exec_lock);
+			kfree(actions);
 			kfree(progname);
-			kfree(arguments);
-			//kfree(u_args);
-			vfs_close(vnode);
-			//curproc->p_addrspace = temporary;
 			return res;
 		}
-		arguments[segment] = (char *)stackptr;
+	}
 
-		kfree(arg);
-		//kprintf("Copied the padded string to stack. Stack: %x\n", stackptr);
+	start = kmalloc(sizeof(*start));
+	argbuf = (char *)alloc_kpages(EXEC_ARGPAGES);
+	if(start == NULL || argbuf == NULL){
+		res = ENOMEM;
+		goto fail_args;
+	}
+	res = exec_packargs(user_args, argbuf, &argc, &strbytes);
+	if(res){
+		goto fail_args;
+	}
 
-		segment++;
+	res = vfs_open(progname, O_RDONLY, 0, &vnode);
+	if(res){
+		goto fail_args;
 	}
 
-	//char * nullp = (char *) NULL;
+	child_proc = proc_create("Child Process");
+	if(child_proc == NULL){
+		res = ENPROC;
+		goto fail_vnode;
+	}
+	child_proc->p_cwd = curproc->p_cwd;
 
-	for (i = segment; i >= 0; i--) {
-		stackptr = stackptr - sizeof(char*);
-		res = copyout((const void *) (arguments+i), (userptr_t) stackptr, (sizeof(char *)));
-		if (res) {
-			kprintf("EXECV. Failed to copyout arg pointers\n");
-			lock_release(exec_lock);
-			kfree(progname);
-			kfree(arguments);
-			//kfree(u_args);
-			vfs_close(vnode);
-			//curproc->p_addrspace = temporary;
-			return res;
+	res = fdtable_copy(curproc->p_fdtable, &child_proc->p_fdtable);
+	if(res){
+		goto fail_proc;
+	}
+	for(i=0; i<nactions; i++){
+		switch(actions[i].sa_op){
+		    case SPAWN_CLOSE:
+			res = fdtable_remove(child_proc->p_fdtable, actions[i].sa_fd);
+			break;
+		    case SPAWN_DUP2:
+			res = fdtable_dup2(child_proc->p_fdtable, actions[i].sa_fd, actions[i].sa_newfd);
+			break;
+		    default:
+			res = EINVAL;
+			break;
 		}
-		//("Copied arg pointer to stack\n");
+		if(res){
+			goto fail_proc;
+		}
+	}
 
-		// if(i == segment){
-		// 	kprintf("Copied NULL pointer to stack\n");
-		// }
-		// else{
-		// 	kprintf("Copied arguments pointer to stack\n");
-		// }
-	
-		
+	res = spawn_load(vnode, argbuf, argc, strbytes, &child_proc->p_addrspace, start);
+	if(res){
+		goto fail_proc;
 	}
 	vfs_close(vnode);
-
+	free_kpages((vaddr_t)argbuf);
+	if(actions != NULL){
+		kfree(actions);
+	}
 	kfree(progname);
-	kfree(arguments);
-	//kfree(u_args);
 
-	lock_release(exec_lock);
+	*retval = child_proc->pid;
+	proc_addchild(curproc, child_proc);
+	res = thread_fork("Child Thread", child_proc, spawn_entry, start, 0);
+	if(res){
+		kfree(start);
+		proc_remchild(child_proc);
+		proc_destroy(child_proc);
+		return res;
+	}
+	return 0;
 
-	enter_new_process(length, (userptr_t) stackptr, NULL, stackptr, entrypoint);
-	panic("panic enter_new_process returned\n");
-	return EINVAL; 
-} 
+ fail_proc:
+	proc_destroy(child_proc);
+ fail_vnode:
+	vfs_close(vnode);
+ fail_args:
+	if(argbuf != NULL){
+		free_kpages((vaddr_t)argbuf);
+	}
+	if(start != NULL){
+		kfree(start);
+	}
+	if(actions != NULL){
+		kfree(actions);
+	}
+	kfree(progname);
+	return res;
+}
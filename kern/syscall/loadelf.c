@@ -42,8 +42,10 @@
  * circumstances, as_prepare_load and as_complete_load probably don't
  * need to do anything.
  *
- * If you wanted to support memory-mapped executables you would need
- * to rearrange this to map each segment.
+ * Without dumbvm, "loading" a chunk only records where in the file it
+ * lives (as_define_filedata); the pages are read in by vm_fault as the
+ * program touches them, so exec costs the same for any size of
+ * program and untouched pages are never read at all.
  *
  * To support dynamically linked executables with shared libraries
  * you'd need to change this to load the "ELF interpreter" (dynamic
@@ -59,6 +61,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include <kern/stat.h>
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -74,6 +77,7 @@
  * change this code to not use uiomove, be sure to check for this case
  * explicitly.
  */
+#if OPT_DUMBVM
 static
 int
 load_segment(struct addrspace *as, struct vnode *v,
@@ -145,6 +149,48 @@ load_segment(struct addrspace *as, struct vnode *v,
 	return result;
 }
 
+#else /* !OPT_DUMBVM */
+
+/*
+ * Arrange for a segment to be paged in from the executable on demand.
+ * The arguments are as for load_segment; FILESIZE bytes at OFFSET are
+ * checked against the file now so a truncated executable still fails
+ * at exec time rather than at some later page fault.
+ */
+static
+int
+map_segment(struct addrspace *as, struct vnode *v,
+	    off_t offset, vaddr_t vaddr,
+	    size_t memsize, size_t filesize)
+{
+	struct stat st;
+	int result;
+
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+	if (filesize == 0) {
+		/* All bss; the pages just start out zero. */
+		return 0;
+	}
+
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+	if (offset < 0 || offset + (off_t)filesize > st.st_size) {
+		kprintf("ELF: segment past end of file - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	DEBUG(DB_EXEC, "ELF: Mapping %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	return as_define_filedata(as, vaddr, filesize, v, offset);
+}
+#endif /* OPT_DUMBVM */
+
 /*
  * Load an ELF executable user program into the current address space.
  *
@@ -288,9 +334,14 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+#if OPT_DUMBVM
 		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
 				      ph.p_memsz, ph.p_filesz,
 				      ph.p_flags & PF_X);
+#else
+		result = map_segment(as, v, ph.p_offset, ph.p_vaddr,
+				     ph.p_memsz, ph.p_filesz);
+#endif
 		if (result) {
 			return result;
 		}
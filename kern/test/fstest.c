@@ -42,6 +42,7 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <lib.h>
+#include <clock.h>
 #include <uio.h>
 #include <thread.h>
 #include <synch.h>
@@ -56,6 +57,8 @@
 #define NTHREADS 12
 #define NLONG    32
 #define NCREATE  24
+#define RBSIZE   (512*1024)	/* file size for the read benchmark */
+#define RBCHUNK  4096		/* and the size it's written in */
 
 static struct semaphore *threadsem = NULL;
 
@@ -674,6 +677,171 @@ docreatestress(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Read throughput. Writes a RBSIZE file, then reads all of it with
+ * each of a range of buffer sizes and reports the rate. This reads
+ * into kernel memory with VOP_READ; /testbin/readbench does the same
+ * through read() into a user buffer.
+ */
+
+static const size_t readbench_sizes[] = {
+	512, 4096, 32768, 131072, 524288,
+};
+
+static
+int
+readbench_write(const char *fs, const char *namesuffix)
+{
+	struct vnode *vn;
+	char name[32];
+	char buf[32];
+	char *data;
+	struct iovec iov;
+	struct uio ku;
+	size_t i;
+	int err;
+
+	MAKENAME();
+
+	data = kmalloc(RBCHUNK);
+	if (data == NULL) {
+		kprintf("readbench: Out of memory\n");
+		return -1;
+	}
+	for (i=0; i<RBCHUNK; i++) {
+		data[i] = SLOGAN[i % strlen(SLOGAN)];
+	}
+
+	/* vfs_open destroys the string it's passed */
+	strcpy(buf, name);
+	err = vfs_open(buf, O_WRONLY|O_CREAT|O_TRUNC, 0664, &vn);
+	if (err) {
+		kprintf("Could not open %s for write: %s\n",
+			name, strerror(err));
+		kfree(data);
+		return -1;
+	}
+
+	for (i=0; i<RBSIZE; i+=RBCHUNK) {
+		uio_kinit(&iov, &ku, data, RBCHUNK, i, UIO_WRITE);
+		err = VOP_WRITE(vn, &ku);
+		if (err || ku.uio_resid > 0) {
+			kprintf("%s: Write error: %s\n", name,
+				err ? strerror(err) : "short write");
+			vfs_close(vn);
+			kfree(data);
+			return -1;
+		}
+	}
+
+	vfs_close(vn);
+	kfree(data);
+	return 0;
+}
+
+static
+int
+readbench_read(const char *fs, const char *namesuffix, size_t bufsize)
+{
+	struct vnode *vn;
+	char name[32];
+	char buf[32];
+	char *data;
+	struct iovec iov;
+	struct uio ku;
+	struct timespec before, after, duration;
+	uint64_t nsecs;
+	off_t pos = 0;
+	int err;
+
+	MAKENAME();
+
+	data = kmalloc(bufsize);
+	if (data == NULL) {
+		kprintf("readbench: Out of memory for %lu-byte buffer\n",
+			(unsigned long) bufsize);
+		return -1;
+	}
+
+	strcpy(buf, name);
+	err = vfs_open(buf, O_RDONLY, 0664, &vn);
+	if (err) {
+		kprintf("Could not open %s for read: %s\n",
+			name, strerror(err));
+		kfree(data);
+		return -1;
+	}
+
+	gettime(&before);
+	while (pos < RBSIZE) {
+		uio_kinit(&iov, &ku, data, bufsize, pos, UIO_READ);
+		err = VOP_READ(vn, &ku);
+		if (err) {
+			kprintf("%s: Read error: %s\n", name, strerror(err));
+			vfs_close(vn);
+			kfree(data);
+			return -1;
+		}
+		if (ku.uio_offset == pos) {
+			break;
+		}
+		pos = ku.uio_offset;
+	}
+	gettime(&after);
+
+	vfs_close(vn);
+	kfree(data);
+
+	if (pos != RBSIZE) {
+		kprintf("%s: %lu bytes read, should have been %lu!\n",
+			name, (unsigned long) pos, (unsigned long) RBSIZE);
+		return -1;
+	}
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	if (nsecs == 0) {
+		nsecs = 1;
+	}
+	kprintf("%7lu-byte reads: %llu.%09lu s, %llu KB/s\n",
+		(unsigned long) bufsize,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec,
+		(unsigned long long) (RBSIZE * 1000000000ULL / nsecs / 1024));
+	return 0;
+}
+
+static
+void
+doreadbench(const char *filesys)
+{
+	unsigned i;
+
+	kprintf("*** Starting fs read benchmark on %s:\n", filesys);
+
+	if (readbench_write(filesys, "")) {
+		kprintf("*** Test failed\n");
+		return;
+	}
+
+	for (i=0; i<ARRAYCOUNT(readbench_sizes); i++) {
+		if (readbench_read(filesys, "", readbench_sizes[i])) {
+			kprintf("*** Test failed\n");
+			fstest_remove(filesys, "");
+			return;
+		}
+	}
+
+	if (fstest_remove(filesys, "")) {
+		kprintf("*** Test failed\n");
+		return;
+	}
+
+	kprintf("*** fs read benchmark done\n");
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 checkfilesystem(int nargs, char **args)
@@ -681,7 +849,7 @@ checkfilesystem(int nargs, char **args)
 	char *device;
 
 	if (nargs != 2) {
-		kprintf("Usage: fs[12345] filesystem:\n");
+		kprintf("Usage: fs[1234567] filesystem:\n");
 		return EINVAL;
 	}
 
@@ -714,6 +882,7 @@ DEFTEST(writestress);
 DEFTEST(writestress2);
 DEFTEST(longstress);
 DEFTEST(createstress);
+DEFTEST(readbench);
 
 ////////////////////////////////////////////////////////////
 
@@ -35,6 +35,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
@@ -341,6 +342,97 @@ locktest3(int nargs, char **args) {
 	return 0;
 }
 
+/*
+ * Lock contention benchmark. NTHREADS threads (or args[1]) hammer one
+ * lock, holding it each time for a loop of args[2] (default 50)
+ * iterations, about as long as a short critical section. Reports the
+ * time per acquisition.
+ */
+#define LT4_LOOPS 2000
+
+static volatile unsigned lt4_holdloops;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	unsigned i;
+	volatile unsigned j;
+
+	for (i=0; i<LT4_LOOPS; i++) {
+		lock_acquire(testlock);
+		testval1++;
+		for (j=0; j<lt4_holdloops; j++) {
+			/* nothing */
+		}
+		lock_release(testlock);
+	}
+	V(donesem);
+}
+
+int
+locktest4(int nargs, char **args)
+{
+	unsigned i, nthreads;
+	struct timespec before, after, duration;
+	uint64_t nsecs;
+	int result;
+
+	nthreads = nargs > 1 ? atoi(args[1]) : NTHREADS;
+	lt4_holdloops = nargs > 2 ? atoi(args[2]) : 50;
+	if (nthreads == 0) {
+		kprintf("Usage: lt4 [threads [holdloops]]\n");
+		return EINVAL;
+	}
+
+	kprintf_n("Starting lt4...\n");
+	testlock = lock_create("testlock");
+	if (testlock == NULL) {
+		panic("lt4: lock_create failed\n");
+	}
+	donesem = sem_create("donesem", 0);
+	if (donesem == NULL) {
+		panic("lt4: sem_create failed\n");
+	}
+	testval1 = 0;
+
+	gettime(&before);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lt4: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("lt4: %u threads, %u acquisitions each, hold %u loops: "
+		"%llu.%09lu seconds, %llu ns per acquisition\n",
+		nthreads, LT4_LOOPS, lt4_holdloops,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec,
+		(unsigned long long) (nsecs / (nthreads * LT4_LOOPS)));
+
+	result = testval1 == nthreads * LT4_LOOPS ?
+		TEST161_SUCCESS : TEST161_FAIL;
+	lock_destroy(testlock);
+	sem_destroy(donesem);
+	testlock = NULL;
+	donesem = NULL;
+
+	success(result, SECRET, "lt4");
+	return 0;
+}
+
 static
 void
 cvtestthread(void *junk, unsigned long num)
@@ -0,0 +1,197 @@
+/*
+ * Test for timers and timed sleeps.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+#include <kern/test161.h>
+
+#define MSECS 1000000ULL
+
+static struct semaphore *tsem;
+static struct lock *tlock;
+static struct cv *tcv;
+static struct semaphore *tdone;
+static int test_status;
+
+static
+void
+fail(const char *msg)
+{
+	kprintf_n("tmt1: FAIL: %s\n", msg);
+	test_status = TEST161_FAIL;
+}
+
+/*
+ * Check that something that should have taken WANT nanoseconds
+ * started at START took at least that, and say by how much it
+ * overshot.
+ */
+static
+void
+check_elapsed(const char *what, uint64_t start, uint64_t want)
+{
+	uint64_t took;
+
+	took = gettime_nsecs() - start;
+	kprintf_n("tmt1: %s: wanted %llu us, took %llu us\n", what,
+		  (unsigned long long)(want / 1000),
+		  (unsigned long long)(took / 1000));
+	if (took < want) {
+		fail("woke up early");
+	}
+}
+
+static
+void
+timerfunc(void *data)
+{
+	uint64_t *fired = data;
+
+	*fired = gettime_nsecs();
+}
+
+/* Wait a bit, then V tsem. */
+static
+void
+vthread(void *junk, unsigned long delay)
+{
+	(void)junk;
+
+	clocksleep_nsecs(delay);
+	V(tsem);
+	V(tdone);
+}
+
+/* Hold tlock for a while. */
+static
+void
+lockthread(void *junk, unsigned long hold)
+{
+	(void)junk;
+
+	lock_acquire(tlock);
+	V(tdone);
+	clocksleep_nsecs(hold);
+	lock_release(tlock);
+	V(tdone);
+}
+
+int
+timertest(int nargs, char **args)
+{
+	struct timer t;
+	volatile uint64_t fired;
+	uint64_t start;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf_n("Starting tmt1...\n");
+	test_status = TEST161_SUCCESS;
+
+	tsem = sem_create("tmt1", 0);
+	tlock = lock_create("tmt1");
+	tcv = cv_create("tmt1");
+	tdone = sem_create("tmt1done", 0);
+	if (tsem == NULL || tlock == NULL || tcv == NULL || tdone == NULL) {
+		panic("tmt1: out of memory\n");
+	}
+
+	/* Plain timer, and cancelling one. */
+	fired = 0;
+	start = gettime_nsecs();
+	timer_init(&t, timerfunc, (void *)&fired);
+	timer_add(&t, start + 3 * MSECS);
+	clocksleep_nsecs(20 * MSECS);
+	if (fired == 0) {
+		fail("timer didn't fire");
+	}
+	else if (fired < start + 3 * MSECS) {
+		fail("timer fired early");
+	}
+	if (timer_cancel(&t)) {
+		fail("cancelled a timer that already fired");
+	}
+	fired = 0;
+	timer_add(&t, gettime_nsecs() + 10 * MSECS);
+	if (!timer_cancel(&t)) {
+		fail("couldn't cancel a pending timer");
+	}
+	clocksleep_nsecs(20 * MSECS);
+	if (fired != 0) {
+		fail("cancelled timer fired");
+	}
+
+	/* Sleeps shorter and longer than a tick. */
+	start = gettime_nsecs();
+	clocksleep_nsecs(2 * MSECS);
+	check_elapsed("2ms sleep", start, 2 * MSECS);
+	start = gettime_nsecs();
+	clocksleep_nsecs(35 * MSECS);
+	check_elapsed("35ms sleep", start, 35 * MSECS);
+
+	/* P_timed: times out, succeeds at once, succeeds after a wait. */
+	start = gettime_nsecs();
+	if (P_timed(tsem, start + 20 * MSECS)) {
+		fail("P_timed on 0 succeeded");
+	}
+	check_elapsed("P_timed timeout", start, 20 * MSECS);
+	V(tsem);
+	if (!P_timed(tsem, gettime_nsecs())) {
+		fail("P_timed on 1 failed");
+	}
+	result = thread_fork("tmt1", NULL, vthread, NULL, 10 * MSECS);
+	if (result) {
+		panic("tmt1: thread_fork failed: %s\n", strerror(result));
+	}
+	if (!P_timed(tsem, gettime_nsecs() + 1000 * MSECS)) {
+		fail("P_timed missed the V");
+	}
+	P(tdone);
+
+	/* lock_acquire_timed against a holder. */
+	result = thread_fork("tmt1", NULL, lockthread, NULL, 50 * MSECS);
+	if (result) {
+		panic("tmt1: thread_fork failed: %s\n", strerror(result));
+	}
+	P(tdone);
+	start = gettime_nsecs();
+	if (lock_acquire_timed(tlock, start + 10 * MSECS)) {
+		fail("lock_acquire_timed got a held lock");
+		lock_release(tlock);
+	}
+	check_elapsed("lock_acquire_timed timeout", start, 10 * MSECS);
+	if (!lock_acquire_timed(tlock, gettime_nsecs() + 1000 * MSECS)) {
+		fail("lock_acquire_timed missed the release");
+	}
+	else {
+		lock_release(tlock);
+	}
+	P(tdone);
+
+	/* cv_wait_timed with nobody signalling. */
+	lock_acquire(tlock);
+	start = gettime_nsecs();
+	if (cv_wait_timed(tcv, tlock, start + 15 * MSECS)) {
+		fail("cv_wait_timed woken by nobody");
+	}
+	check_elapsed("cv_wait_timed timeout", start, 15 * MSECS);
+	if (!lock_do_i_hold(tlock)) {
+		fail("cv_wait_timed didn't reacquire the lock");
+	}
+	lock_release(tlock);
+
+	sem_destroy(tsem);
+	lock_destroy(tlock);
+	cv_destroy(tcv);
+	sem_destroy(tdone);
+
+	success(test_status, SECRET, "tmt1");
+	return 0;
+}
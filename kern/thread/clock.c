@@ -30,17 +30,22 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spl.h>
 #include <wchan.h>
 #include <clock.h>
+#include <timer.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks at specific points in the future are timers (see timer.c),
+ * which run from hardclock() on the cpu that set them. Each cpu's
+ * timer interrupt is programmed one-shot for whichever is sooner, its
+ * next scheduler tick or its next timer, so timers have much better
+ * than tick resolution; and idle cpus don't take ticks at all.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,12 +58,21 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+#define TICK_NSECS		(1000000000 / HZ)
+#define IDLE_MAX_NSECS		1000000000ULL	/* Longest idle sleep. */
+
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
  */
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Threads in clocksleep_nsecs wait here; only their timers wake them.
+ */
+static struct wchan *napping;
+static struct spinlock napping_lock;
+
 /*
  * Setup.
  */
@@ -70,6 +84,34 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&napping_lock);
+	napping = wchan_create("napping");
+	if (napping == NULL) {
+		panic("Couldn't create napping\n");
+	}
+}
+
+/*
+ * Switch the current cpu over to programmed timer interrupts.
+ */
+void
+hardclock_start(void)
+{
+	int spl;
+
+	spl = splhigh();
+	curcpu->c_nexttick = gettime_nsecs() + TICK_NSECS;
+	hardclock_reprogram();
+	splx(spl);
+}
+
+uint64_t
+gettime_nsecs(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
 /*
@@ -86,11 +128,12 @@ timerclock(void)
 }
 
 /*
- * This is called HZ times a second (on each processor) by the timer
- * code.
+ * One scheduler tick. Returns true if the current thread should
+ * yield.
  */
-void
-hardclock(void)
+static
+bool
+hardclock_tick(void)
 {
 	/*
 	 * Collect statistics here as desired.
@@ -103,7 +146,91 @@ hardclock(void)
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	return thread_timeslice();
+}
+
+/*
+ * This is called on every timer interrupt (on each processor) by the
+ * timer code: HZ times a second while busy, plus whenever a timer is
+ * due.
+ */
+void
+hardclock(void)
+{
+	uint64_t now;
+	bool yield;
+
+	if (curcpu->c_nexttick == 0) {
+		/* Not started yet; the timer is still just periodic. */
+		yield = hardclock_tick();
+	}
+	else {
+		now = gettime_nsecs();
+		timer_run(now);
+
+		yield = false;
+		if (!curcpu->c_isidle && now >= curcpu->c_nexttick) {
+			curcpu->c_nexttick += TICK_NSECS;
+			if (curcpu->c_nexttick <= now) {
+				/* Fell behind; don't try to catch up. */
+				curcpu->c_nexttick = now + TICK_NSECS;
+			}
+			yield = hardclock_tick();
+		}
+		hardclock_reprogram();
+	}
+
+	if (yield) {
+		thread_yield();
+	}
+}
+
+/*
+ * Program the current cpu's next timer interrupt: for its next timer,
+ * and if it isn't idle, no later than its next tick.
+ */
+void
+hardclock_reprogram(void)
+{
+	uint64_t now, next;
+	int spl;
+
+	if (curcpu->c_nexttick == 0) {
+		return;
+	}
+
+	spl = splhigh();
+	now = gettime_nsecs();
+	next = timer_next();
+	if (curcpu->c_isidle) {
+		if (next > now + IDLE_MAX_NSECS) {
+			next = now + IDLE_MAX_NSECS;
+		}
+	}
+	else if (next > curcpu->c_nexttick) {
+		next = curcpu->c_nexttick;
+	}
+	mainbus_settimer(next > now ? next - now : 0);
+	splx(spl);
+}
+
+/*
+ * The current cpu was idle and is about to run a thread again: start
+ * ticking.
+ */
+void
+hardclock_unidle(void)
+{
+	int spl;
+
+	if (curcpu->c_nexttick == 0) {
+		return;
+	}
+
+	spl = splhigh();
+	curcpu->c_nexttick = gettime_nsecs() + TICK_NSECS;
+	hardclock_reprogram();
+	splx(spl);
 }
 
 /*
@@ -119,3 +246,19 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for NSECS nanoseconds.
+ */
+void
+clocksleep_nsecs(uint64_t nsecs)
+{
+	uint64_t deadline;
+
+	deadline = gettime_nsecs() + nsecs;
+	spinlock_acquire(&napping_lock);
+	while (wchan_timedsleep(napping, &napping_lock, deadline)) {
+		/* Nobody else should wake us, but just in case. */
+	}
+	spinlock_release(&napping_lock);
+}
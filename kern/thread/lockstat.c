@@ -0,0 +1,308 @@
+/*
+ * Lock contention statistics. See <lockstat.h>.
+ *
+ * Records live in a fixed open-addressed hash table and are never
+ * removed, so once a slot's ls_site is set it stays the same key.
+ * Lookups run without any lock; a new record is filled in under
+ * lockstat_tablelock and then published by setting ls_site. The
+ * counters of each record are protected by its ls_lock.
+ *
+ * These are bare lock words taken at splhigh rather than spinlocks,
+ * since they are used from inside spinlock_acquire and
+ * spinlock_release.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_SIZE 512
+#define LOCKSTAT_NAMELEN 24
+
+struct lockstat {
+	const void *ls_site;		/* NULL if the slot is free */
+	unsigned ls_kind;
+	char ls_name[LOCKSTAT_NAMELEN];	/* truncated copy */
+	volatile spinlock_data_t ls_lock;
+	uint64_t ls_acquires;
+	uint64_t ls_contended;
+	uint64_t ls_waittime;
+	uint64_t ls_maxwait;
+	uint64_t ls_holdtime;
+};
+
+static struct lockstat lockstat_table[LOCKSTAT_SIZE];
+static volatile spinlock_data_t lockstat_tablelock;
+static unsigned lockstat_dropped;	/* acquisitions not counted */
+static volatile bool lockstat_recording;
+
+static const char *const lockstat_kinds[] = {
+	[LOCKSTAT_SPINLOCK] = "spin",
+	[LOCKSTAT_LOCK] = "lock",
+	[LOCKSTAT_CV] = "cv",
+};
+
+static
+void
+lockstat_lockword(volatile spinlock_data_t *word)
+{
+	while (spinlock_data_get(word) != 0 ||
+	       spinlock_data_testandset(word) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_unlockword(volatile spinlock_data_t *word)
+{
+	membar_any_store();
+	spinlock_data_set(word, 0);
+}
+
+static
+unsigned
+lockstat_hash(unsigned kind, const char *name, const void *site)
+{
+	unsigned h, i;
+
+	h = kind * 31 + (uintptr_t)site / 4;
+	for (i = 0; i < LOCKSTAT_NAMELEN - 1 && name[i] != 0; i++) {
+		h = h * 31 + (unsigned char)name[i];
+	}
+	return h;
+}
+
+static
+bool
+lockstat_match(struct lockstat *ls, unsigned kind, const char *name,
+	       const void *site)
+{
+	unsigned i;
+
+	if (ls->ls_site != site || ls->ls_kind != kind) {
+		return false;
+	}
+	for (i = 0; i < LOCKSTAT_NAMELEN - 1; i++) {
+		if (ls->ls_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find the record for (KIND, NAME, SITE), adding it if needed. Returns
+ * NULL if the table is full. Called at splhigh.
+ */
+static
+struct lockstat *
+lockstat_find(unsigned kind, const char *name, const void *site)
+{
+	struct lockstat *ls;
+	unsigned h, n, i;
+
+	h = lockstat_hash(kind, name, site);
+	for (n = 0; n < LOCKSTAT_SIZE; n++) {
+		ls = &lockstat_table[(h + n) % LOCKSTAT_SIZE];
+		if (ls->ls_site == NULL) {
+			break;
+		}
+		membar_load_load();
+		if (lockstat_match(ls, kind, name, site)) {
+			return ls;
+		}
+	}
+
+	/* Not there; add it, unless someone else just did. */
+	lockstat_lockword(&lockstat_tablelock);
+	for (; n < LOCKSTAT_SIZE; n++) {
+		ls = &lockstat_table[(h + n) % LOCKSTAT_SIZE];
+		if (ls->ls_site == NULL) {
+			ls->ls_kind = kind;
+			for (i = 0; i < LOCKSTAT_NAMELEN - 1 && name[i] != 0;
+			     i++) {
+				ls->ls_name[i] = name[i];
+			}
+			ls->ls_name[i] = 0;
+			spinlock_data_set(&ls->ls_lock, 0);
+			ls->ls_acquires = 0;
+			ls->ls_contended = 0;
+			ls->ls_waittime = 0;
+			ls->ls_maxwait = 0;
+			ls->ls_holdtime = 0;
+			membar_store_store();
+			ls->ls_site = site;
+			lockstat_unlockword(&lockstat_tablelock);
+			return ls;
+		}
+		if (lockstat_match(ls, kind, name, site)) {
+			lockstat_unlockword(&lockstat_tablelock);
+			return ls;
+		}
+	}
+	lockstat_dropped++;
+	lockstat_unlockword(&lockstat_tablelock);
+	return NULL;
+}
+
+void
+lockstat_bootstrap(void)
+{
+	spinlock_data_set(&lockstat_tablelock, 0);
+	membar_store_store();
+	lockstat_recording = true;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	return lockstat_recording ? gettime_nsecs() : 0;
+}
+
+struct lockstat *
+lockstat_acquired(unsigned kind, const char *name, const void *site,
+		  bool contended, uint64_t start, uint64_t now)
+{
+	struct lockstat *ls;
+	uint64_t wait;
+	int spl;
+
+	if (start == 0) {
+		/* Started waiting before we were recording. */
+		return NULL;
+	}
+	wait = now - start;
+
+	spl = splhigh();
+	ls = lockstat_find(kind, name != NULL ? name : "", site);
+	if (ls != NULL) {
+		lockstat_lockword(&ls->ls_lock);
+		ls->ls_acquires++;
+		if (contended) {
+			ls->ls_contended++;
+		}
+		ls->ls_waittime += wait;
+		if (wait > ls->ls_maxwait) {
+			ls->ls_maxwait = wait;
+		}
+		lockstat_unlockword(&ls->ls_lock);
+	}
+	splx(spl);
+	return ls;
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t holdstart, uint64_t now)
+{
+	int spl;
+
+	if (ls == NULL) {
+		return;
+	}
+
+	spl = splhigh();
+	lockstat_lockword(&ls->ls_lock);
+	ls->ls_holdtime += now - holdstart;
+	lockstat_unlockword(&ls->ls_lock);
+	splx(spl);
+}
+
+void
+lockstat_dump(unsigned n)
+{
+	struct lockstat *snap, *ls, tmp;
+	unsigned count, i, j, best;
+	int spl;
+
+	/* Copy the records out, so they don't change as we sort. */
+	snap =kmalloc(LOCKSTAT_SIZE * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	count = 0;
+	for (i = 0; i < LOCKSTAT_SIZE; i++) {
+		ls = &lockstat_table[i];
+		if (ls->ls_site == NULL) {
+			continue;
+		}
+		membar_load_load();
+		spl = splhigh();
+		lockstat_lockword(&ls->ls_lock);
+		snap[count++] = *ls;
+		lockstat_unlockword(&ls->ls_lock);
+		splx(spl);
+	}
+
+	/* Selection sort, as far as we're printing. */
+	if (n > count) {
+		n = count;
+	}
+	for (i = 0; i < n; i++) {
+		best = i;
+		for (j = i + 1; j < count; j++) {
+			if (snap[j].ls_waittime > snap[best].ls_waittime) {
+				best = j;
+			}
+		}
+		tmp = snap[i];
+		snap[i] = snap[best];
+		snap[best] = tmp;
+	}
+
+	kprintf("lockstat: %u records, %u acquisitions dropped; "
+		"top %u by wait time (ns):\n", count, lockstat_dropped, n);
+	kprintf("%-4s %-20s %-10s %9s %9s %12s %10s %12s\n",
+		"kind", "name", "site", "acquires", "contended",
+		"wait", "maxwait", "hold");
+	for (i = 0; i < n; i++) {
+		ls = &snap[i];
+		kprintf("%-4s %-20s %-10p %9llu %9llu %12llu %10llu %12llu\n",
+			lockstat_kinds[ls->ls_kind],
+			ls->ls_name[0] != 0 ? ls->ls_name : "-",
+			ls->ls_site, ls->ls_acquires, ls->ls_contended,
+			ls->ls_waittime, ls->ls_maxwait, ls->ls_holdtime);
+	}
+
+	kfree(snap);
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	/*
+	 * Keep the keys: locks held right now still point at their
+	 * records.
+	 */
+	for (i = 0; i < LOCKSTAT_SIZE; i++) {
+		ls = &lockstat_table[i];
+		if (ls->ls_site == NULL) {
+			continue;
+		}
+		membar_load_load();
+		spl = splhigh();
+		lockstat_lockword(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waittime = 0;
+		ls->ls_maxwait = 0;
+		ls->ls_holdtime = 0;
+		lockstat_unlockword(&ls->ls_lock);
+		splx(spl);
+	}
+	lockstat_dropped = 0;
+}
@@ -38,6 +38,7 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -52,6 +53,10 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+#if OPT_LOCKSTAT
+	splk->splk_stat = NULL;
+	splk->splk_acqtime = 0;
+#endif
 }
 
 /*
@@ -75,6 +80,10 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	uint64_t start = 0, now;
+	bool contended;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,6 +99,14 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+#if OPT_LOCKSTAT
+	if (mycpu != NULL) {
+		start = lockstat_now();
+	}
+	/* Not exact: a test-and-set lost to another cpu doesn't count. */
+	contended = (spinlock_data_get(&splk->splk_lock) != 0);
+#endif
+
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -112,6 +129,18 @@ spinlock_acquire(struct spinlock *splk)
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (start != 0) {
+		now = lockstat_now();
+		splk->splk_stat = lockstat_acquired(LOCKSTAT_SPINLOCK, NULL,
+			__builtin_return_address(0), contended, start, now);
+		splk->splk_acqtime = now;
+	}
+	else {
+		splk->splk_stat = NULL;
+	}
+#endif
 }
 
 /*
@@ -127,6 +156,13 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	if (splk->splk_stat != NULL) {
+		lockstat_released(splk->splk_stat, splk->splk_acqtime,
+				  lockstat_now());
+	}
+#endif
+
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
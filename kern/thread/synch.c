@@ -36,9 +36,11 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -120,6 +122,26 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+bool
+P_timed(struct semaphore *sem, uint64_t deadline)
+{
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0 &&
+	       wchan_timedsleep(sem->sem_wchan, &sem->sem_lock, deadline)) {
+		/* woken up; look again */
+	}
+	if (sem->sem_count == 0) {
+		spinlock_release(&sem->sem_lock);
+		return false;
+	}
+	sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+	return true;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -163,7 +185,13 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_thread = NULL;
+	lock->lk_cpu = NULL;
 	lock->lk_status = 0;
+	lock->lk_waiters = 0;
+#if OPT_LOCKSTAT
+	lock->lk_stat = NULL;
+	lock->lk_acqtime = 0;
+#endif
 	return lock;
 }
 
@@ -182,20 +210,141 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * True if OWNER, which holds LOCK, is running right now on some other
+ * cpu.
+ *
+ * The owner may release the lock, exit, and be freed while we look,
+ * so its thread structure is left alone; instead we see whether the
+ * cpu it got the lock on is running it. cpus never go away. If the
+ * owner has moved to another cpu since, we just stop spinning and go
+ * to sleep, and the callers recheck lk_thread every time around.
+ */
+static
+bool
+lock_owner_running(struct lock *lock, struct thread *owner)
+{
+	volatile struct cpu *c = lock->lk_cpu;
+
+	return owner != NULL && c != NULL && c != curcpu->c_self &&
+		c->c_curthread == owner;
+}
+
+/*
+ * Adaptive part of lock_acquire: if the owner is running on another
+ * cpu, it'll most likely release the lock in a moment, sooner than we
+ * could go to sleep and be woken up again. So wait for it by spinning
+ * (with lk_lock released, so the owner can get at it) until the lock
+ * changes hands or the owner stops running. Returns false without
+ * spinning if the owner isn't running, in which case the caller should
+ * sleep.
+ */
+static
+bool
+lock_spin(struct lock *lock)
+{
+	struct thread *owner;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+	owner = lock->lk_thread;
+	if (!lock_owner_running(lock, owner)) {
+		return false;
+	}
+	spinlock_release(&lock->lk_lock);
+	while (lock->lk_thread == owner && lock_owner_running(lock, owner)) {
+		/* spin */
+	}
+	spinlock_acquire(&lock->lk_lock);
+	return true;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+#if OPT_LOCKSTAT
+	uint64_t start, now;
+	bool contended;
+#endif
+
 	KASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
 	spinlock_acquire(&lock->lk_lock);
+#if OPT_LOCKSTAT
+	contended = (lock->lk_status == 1);
+#endif
 	while(lock->lk_status == 1){
+		if(lock_spin(lock)){
+			continue;
+		}
+		lock->lk_waiters++;
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		lock->lk_waiters--;
 	}
 	KASSERT(lock->lk_status == 0);
 	lock->lk_status = 1;
 	lock->lk_thread = curthread;
+	lock->lk_cpu = curcpu->c_self;
+
+	spinlock_release(&lock->lk_lock);
+
+#if OPT_LOCKSTAT
+	/* These belong to the holder, so no need for lk_lock. */
+	now = lockstat_now();
+	lock->lk_stat = lockstat_acquired(LOCKSTAT_LOCK, lock->lk_name,
+		__builtin_return_address(0), contended, start, now);
+	lock->lk_acqtime = now;
+#endif
+}
+
+/*
+ * This one doesn't spin, as the owner could keep running past the
+ * deadline.
+ */
+bool
+lock_acquire_timed(struct lock *lock, uint64_t deadline)
+{
+	bool woken = true;
+#if OPT_LOCKSTAT
+	uint64_t start, now;
+	bool contended;
+#endif
+
+	KASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
+	spinlock_acquire(&lock->lk_lock);
+#if OPT_LOCKSTAT
+	contended = (lock->lk_status == 1);
+#endif
+	while(lock->lk_status == 1 && woken){
+		lock->lk_waiters++;
+		woken = wchan_timedsleep(lock->lk_wchan, &lock->lk_lock,
+					 deadline);
+		lock->lk_waiters--;
+	}
+	if(lock->lk_status == 1){
+		spinlock_release(&lock->lk_lock);
+		return false;
+	}
+	lock->lk_status = 1;
+	lock->lk_thread = curthread;
+	lock->lk_cpu = curcpu->c_self;
 
 	spinlock_release(&lock->lk_lock);
+
+#if OPT_LOCKSTAT
+	now = lockstat_now();
+	lock->lk_stat = lockstat_acquired(LOCKSTAT_LOCK, lock->lk_name,
+		__builtin_return_address(0), contended, start, now);
+	lock->lk_acqtime = now;
+#endif
+	return true;
 }
 
 void
@@ -203,12 +352,20 @@ lock_release(struct lock *lock)
 {
 	KASSERT(lock != NULL);
 	KASSERT(lock_do_i_hold(lock));
+#if OPT_LOCKSTAT
+	if (lock->lk_stat != NULL) {
+		lockstat_released(lock->lk_stat, lock->lk_acqtime,
+				  lockstat_now());
+		lock->lk_stat = NULL;
+	}
+#endif
 	spinlock_acquire(&lock->lk_lock);
 
 	if(lock_do_i_hold(lock)){
 		lock->lk_status = 0;
 		lock->lk_thread = NULL;
-		if(!wchan_isempty(lock->lk_wchan, &lock->lk_lock)){
+		/* Spinners don't count; they'll see lk_thread change. */
+		if(lock->lk_waiters > 0){
 			wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 		}
 	}
@@ -287,6 +444,10 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
+
 	// Write this
 	// (void)cv;    // suppress warning until code gets written
 	// (void)lock;  // suppress warning until code gets written
@@ -315,11 +476,44 @@ cv_wait(struct cv *cv, struct lock *lock)
 	
 	
 	
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
 	spinlock_acquire(&cv->cv_lock);
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_lock);
 	spinlock_release(&cv->cv_lock);
+#if OPT_LOCKSTAT
+	/* Time asleep; getting the lock back is counted separately. */
+	lockstat_acquired(LOCKSTAT_CV, cv->cv_name,
+		__builtin_return_address(0), true, start, lockstat_now());
+#endif
+	lock_acquire(lock);
+}
+
+bool
+cv_wait_timed(struct cv *cv, struct lock *lock, uint64_t deadline)
+{
+	bool woken;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
+
+	KASSERT(lock_do_i_hold(lock));
+
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
+	spinlock_acquire(&cv->cv_lock);
+	lock_release(lock);
+	woken = wchan_timedsleep(cv->cv_wchan, &cv->cv_lock, deadline);
+	spinlock_release(&cv->cv_lock);
+#if OPT_LOCKSTAT
+	lockstat_acquired(LOCKSTAT_CV, cv->cv_name,
+		__builtin_return_address(0), true, start, lockstat_now());
+#endif
 	lock_acquire(lock);
+	return woken;
 }
 
 void
@@ -47,6 +47,8 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <clock.h>
+#include <timer.h>
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
@@ -146,6 +148,8 @@ thread_create(const char *name)
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_priority = 0;
+	thread->t_ticksleft = SCHED_QUANTUM(0);
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -155,11 +159,6 @@ thread_create(const char *name)
 	/* If you add to struct thread, be sure to initialize here */
 
 
-	//Initialize the File table
-	for(int i=0; i<OPEN_MAX; i++){
-		thread->file_table[i] = NULL;
-	}
-
 	// thread->t_pid = pid_alloc();
 	// thread->ppid = 2;
 	// pid_t id = givepid();
@@ -200,11 +199,22 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_nexttick = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	c->c_runqueue_len = 0;
+
+	timer_bootstrap(&c->c_timers);
+
+	c->c_npagecache = 0;
+	c->c_pagecache_hits = 0;
+	c->c_pagecache_misses = 0;
+	c->c_pagecache_refills = 0;
+	c->c_pagecache_drains = 0;
+	spinlock_init(&c->c_pagecache_lock);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -272,6 +282,18 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Look up a cpu by software number.
+ */
+struct cpu *
+cpu_get(unsigned index)
+{
+	if (index >= cpuarray_num(&allcpus)) {
+		return NULL;
+	}
+	return cpuarray_get(&allcpus, index);
+}
+
 /*
  * Destroy a thread.
  *
@@ -348,6 +370,7 @@ thread_panic(void)
 	curcpu->c_runqueue.tl_count = 0;
 	curcpu->c_runqueue.tl_head.tln_next = &curcpu->c_runqueue.tl_tail;
 	curcpu->c_runqueue.tl_tail.tln_prev = &curcpu->c_runqueue.tl_head;
+	curcpu->c_runqueue_len = 0;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -430,6 +453,7 @@ cpu_hatch(unsigned software_number)
 
 	spl0();
 	cpu_identify(buf, sizeof(buf));
+	hardclock_start();
 
 	V(cpu_startup_sem);
 	thread_exit();
@@ -446,6 +470,7 @@ thread_start_cpus(void)
 
 	cpu_identify(buf, sizeof(buf));
 	kprintf("cpu0: %s\n", buf);
+	hardclock_start();
 
 	cpu_startup_sem = sem_create("cpu_hatch", 0);
 	thread_count_wchan = wchan_create("thread_count");
@@ -470,6 +495,62 @@ thread_start_cpus(void)
 	thread_count = 1;
 }
 
+/*
+ * Put T on C's run queue behind every thread of the same or higher
+ * priority. The queue thus stays sorted by priority, and round-robin
+ * within each level.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct thread *prev;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL_REV(prev, c->c_runqueue) {
+		if (prev->t_priority <= t->t_priority) {
+			break;
+		}
+	}
+	if (prev != NULL) {
+		threadlist_insertafter(&c->c_runqueue, prev, t);
+	}
+	else {
+		threadlist_addhead(&c->c_runqueue, t);
+	}
+	c->c_runqueue_len = c->c_runqueue.tl_count;
+}
+
+/*
+ * Choose a cpu for a new thread: the one with the fewest threads
+ * running or ready, going by the c_runqueue_len hints. Ties go to
+ * the current cpu, whose cache already has the parent's state.
+ */
+static
+struct cpu *
+thread_pickcpu(void)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus, load, bestload;
+
+	best = curcpu->c_self;
+	bestload = best->c_runqueue_len + 1;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus && bestload > 0; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == best) {
+			continue;
+		}
+		load = c->c_runqueue_len + (c->c_isidle ? 0 : 1);
+		if (load < bestload) {
+			best = c;
+			bestload = load;
+		}
+	}
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -492,9 +573,21 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	/*
+	 * A thread waking up from a sleep gave up the cpu before its
+	 * quantum ran out; move it up a level.
+	 */
+	if (target->t_state == S_SLEEP && target->t_priority > 0) {
+		target->t_priority--;
+		if (target->t_ticksleft > SCHED_QUANTUM(target->t_priority)) {
+			target->t_ticksleft =
+				SCHED_QUANTUM(target->t_priority);
+		}
+	}
+
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -551,28 +644,15 @@ thread_fork(const char *name,
 	 * Now we clone various fields from the parent thread.
 	 */
 
-	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	/*
+	 * Thread subsystem fields. The new thread doesn't necessarily
+	 * run where its parent does; spread out bursts of forks.
+	 */
+	newthread->t_cpu = thread_pickcpu();
+	newthread->t_priority = curthread->t_priority;
+	newthread->t_ticksleft = SCHED_QUANTUM(newthread->t_priority);
 	// const char *lockname = "Child_Ftable_lock";
 
-	//Copy the File table
-	for(int i=0 ;i<OPEN_MAX;i++){
-		if(curthread->file_table[i]!=NULL){
-			lock_acquire(curthread->file_table[i]->filelock);
-			newthread->file_table[i] = (struct file_handle *)kmalloc(sizeof(struct file_handle*));
-			//memcpy(newthread->file_table[i], curthread->file_table[i], sizeof(struct file_handle*));
-			// newthread->file_table[i]->filelock = lock_create(lockname);
-			// newthread->file_table[i]->filelock = curthread->file_table[i]->filelock;
-			// // newthread->file_table[i]->flags = curthread->file_table[i]->flags;
-			// // newthread->file_table[i]->offset = curthread->file_table[i]->offset;
-			// newthread->file_table[i]->ref_count = curthread->file_table[i]->ref_count;
-			// newthread->file_table[i]->vnode = curthread->file_table[i]->vnode;
-			newthread->file_table[i] = curthread->file_table[i];
-			curthread->file_table[i]->ref_count++;
-			lock_release(curthread->file_table[i]->filelock);
-		}
-	}
-
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
 		proc = curthread->t_proc;
@@ -599,13 +679,96 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the new thread's cpu's run queue and make it runnable */
 	thread_make_runnable(newthread, false);
 
 
 	return 0;
 }
 
+/*
+ * Work stealing. Called by thread_switch when this cpu's run queue is
+ * empty, with no locks held. Takes about half of the ready threads of
+ * the busiest other cpu and returns true, or returns false if no cpu
+ * has work to spare.
+ *
+ * The victim is picked from the c_runqueue_len hints without locking
+ * anything. Idle cpus are passed over: whatever is on their queue was
+ * just woken there and they're about to run it. On ties, the cpu
+ * nearest by number wins, so idle cpus spread out over the busy ones
+ * instead of all piling onto the first. Threads are taken from the
+ * tail of the victim's queue, the ones that would wait longest there
+ * and so have the least left in its cache.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	unsigned i, numcpus, len, best, nsteal;
+	struct threadlist stolen;
+	struct thread *t, *skipped;
+
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=1; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, (curcpu->c_number + i) % numcpus);
+		len = c->c_runqueue_len;
+		if (!c->c_isidle && len > best) {
+			victim = c;
+			best = len;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	threadlist_init(&stolen);
+	skipped = NULL;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	nsteal = DIVROUNDUP(victim->c_runqueue.tl_count, 2);
+	while (nsteal > 0) {
+		t = threadlist_remtail(&victim->c_runqueue);
+		if (t == NULL) {
+			break;
+		}
+		if (t == victim->c_curthread) {
+			/*
+			 * Woken up before the victim finished going
+			 * idle; see thread_consider_migration for why
+			 * we mustn't take it.
+			 */
+			skipped = t;
+			continue;
+		}
+		t->t_cpu = curcpu->c_self;
+		threadlist_addhead(&stolen, t);
+		nsteal--;
+	}
+	if (skipped != NULL) {
+		thread_enqueue(victim, skipped);
+	}
+	victim->c_runqueue_len = victim->c_runqueue.tl_count;
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (threadlist_isempty(&stolen)) {
+		threadlist_cleanup(&stolen);
+		return false;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&stolen)) != NULL) {
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
+		thread_enqueue(curcpu, t);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	threadlist_cleanup(&stolen);
+	return true;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -621,6 +784,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	bool idled;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -646,8 +810,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. That
+	 * includes yielding when everything waiting is of lower
+	 * priority; we'd just be put back in front of it.
+	 */
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	if (newstate == S_READY &&
+	    (next == NULL || next->t_priority > cur->t_priority)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -681,10 +851,15 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
-	 * curcpu->c_isidle must be true when cpu_idle is
-	 * called. Unlock the runqueue while idling too, to make sure
-	 * things can be added to it.
+	 * Get the next thread. While there isn't one, try to steal
+	 * some from another cpu, and if that fails call cpu_idle().
+	 * curcpu->c_isidle must be true when cpu_idle is called.
+	 *
+	 * The timer interrupt is reprogrammed before idling so we
+	 * don't wake up for ticks, and again after.
+	 *
+	 * Unlock the runqueue while idling too, to make sure things
+	 * can be added to it.
 	 *
 	 * Note that we don't need to unlock the runqueue atomically
 	 * with idling; becoming unidle requires receiving an
@@ -699,15 +874,24 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
+	idled = false;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!thread_steal()) {
+				hardclock_reprogram();
+				cpu_idle();
+				idled = true;
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
+	curcpu->c_runqueue_len = curcpu->c_runqueue.tl_count;
 	curcpu->c_isidle = false;
+	if (idled) {
+		hardclock_unidle();
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -891,17 +1075,84 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multilevel feedback queue. Each thread has a priority
+ * from 0 (highest) to SCHED_NLEVELS-1 and each cpu's run queue is
+ * kept sorted by it, so thread_switch always picks the first thread
+ * of the highest level that has one.
+ *
+ *   - New threads start at the top, or at their parent's level if
+ *     forked from a thread.
+ *   - A thread that runs through its whole quantum (which doubles at
+ *     each level down) drops a level; see thread_timeslice.
+ *   - A thread that wakes up from a sleep goes up a level; see
+ *     thread_make_runnable.
+ *   - Every SCHED_BOOST_HARDCLOCKS, everything runnable goes back to
+ *     the top, so CPU-bound threads can't be starved indefinitely.
+ *
+ * Interactive threads thus stay near the top and preempt compute
+ * jobs as soon as they wake up, while the compute jobs get longer
+ * time slices and switch less.
+ */
+
+/* Must be a multiple of SCHEDULE_HARDCLOCKS in clock.c. */
+#define SCHED_BOOST_HARDCLOCKS HZ
+
+/*
+ * Called from hardclock() every tick, before any yield.
  */
+bool
+thread_timeslice(void)
+{
+	struct thread *cur, *next;
+	bool preempt;
+
+	if (curcpu->c_isidle) {
+		return false;
+	}
+	cur = curthread;
+
+	KASSERT(cur->t_ticksleft > 0);
+	cur->t_ticksleft--;
+	if (cur->t_ticksleft == 0) {
+		if (cur->t_priority < SCHED_NLEVELS - 1) {
+			cur->t_priority++;
+		}
+		cur->t_ticksleft = SCHED_QUANTUM(cur->t_priority);
+		return true;
+	}
 
+	/* Something more important came along; let it have the cpu. */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	preempt = next != NULL && next->t_priority < cur->t_priority;
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return preempt;
+}
+
+/*
+ * This is called periodically from hardclock(). It does the
+ * periodic priority boost.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *t;
+
+	if (curcpu->c_hardclocks % SCHED_BOOST_HARDCLOCKS != 0) {
+		return;
+	}
+
+	/* The queue order doesn't change: everything ends up level 0. */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		t->t_priority = 0;
+		t->t_ticksleft = SCHED_QUANTUM(0);
+	}
+	if (!curcpu->c_isidle) {
+		curthread->t_priority = 0;
+		curthread->t_ticksleft = SCHED_QUANTUM(0);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
@@ -911,6 +1162,11 @@ schedule(void)
  * CPU is busy and other CPUs are idle, or less busy, it should move
  * threads across to those other other CPUs.
  *
+ * Idle CPUs don't wait for this; they steal work for themselves in
+ * thread_steal. This is what evens out CPUs that are all busy but
+ * have unequal queues. It goes by the c_runqueue_len hints, so it
+ * doesn't have to lock every CPU's run queue just to count.
+ *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
  * which is fairly slow. The tradeoff between this performance loss
@@ -930,16 +1186,12 @@ thread_consider_migration(void)
 	struct threadlist victims;
 	struct thread *t;
 
-	my_count = total_count = 0;
+	my_count = curcpu->c_runqueue_len;
+	total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
+		total_count += c->c_runqueue_len;
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
@@ -950,10 +1202,15 @@ thread_consider_migration(void)
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (to_send > curcpu->c_runqueue.tl_count) {
+		/* The hint was stale. */
+		to_send = curcpu->c_runqueue.tl_count;
+	}
 	for (i=0; i<to_send; i++) {
 		t = threadlist_remtail(&curcpu->c_runqueue);
 		threadlist_addhead(&victims, t);
 	}
+	curcpu->c_runqueue_len = curcpu->c_runqueue.tl_count;
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
@@ -993,7 +1250,7 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_enqueue(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -1017,7 +1274,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -1089,6 +1346,71 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Timeout for wchan_timedsleep. If the thread is still on the
+ * channel, take it off and wake it up.
+ */
+struct wchan_timeout {
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+static
+void
+wchan_timeout(void *data)
+{
+	struct wchan_timeout *wt = data;
+
+	spinlock_acquire(wt->wt_lock);
+	if (wchan_wakethread(wt->wt_wchan, wt->wt_lock, wt->wt_thread)) {
+		wt->wt_expired = true;
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+/*
+ * Sleep on a wait channel with a deadline.
+ *
+ * The timer is set while we still hold LK, and its function takes
+ * LK, so it can't fire until we're on the channel. It must be
+ * cancelled without LK, since cancelling waits for it if it's
+ * running.
+ */
+bool
+wchan_timedsleep(struct wchan *wc, struct spinlock *lk, uint64_t deadline)
+{
+	struct wchan_timeout wt;
+	struct timer t;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	if (gettime_nsecs() >= deadline) {
+		return false;
+	}
+
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	timer_init(&t, wchan_timeout, &wt);
+	timer_add(&t, deadline);
+
+	thread_switch(S_SLEEP, wc, lk);
+
+	timer_cancel(&t);
+	spinlock_acquire(lk);
+	return !wt.wt_expired;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1151,6 +1473,26 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up one particular thread, if it's sleeping on a wait channel.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *t)
+{
+	struct thread *target;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	THREADLIST_FORALL(target, wc->wc_threads) {
+		if (target == t) {
+			threadlist_remove(&wc->wc_threads, t);
+			thread_make_runnable(t, false);
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -0,0 +1,214 @@
+/*
+ * Kernel timeouts. See <timer.h>.
+ *
+ * Each cpu's wheel is protected by its tw_lock, which other cpus take
+ * only to cancel timers. Timer functions are called with the lock
+ * released; tw_running records which one is being called so
+ * timer_cancel on another cpu can wait it out.
+ *
+ * A timer goes in the slot of its deadline, unless that slot has
+ * already been run, in which case it goes in the slot timer_run will
+ * look at next. Everything in a slot at or behind tw_runslot is thus
+ * due at the next timer_run, and for any later slot S the wheel's
+ * entry S % TIMER_WHEELSIZE holds that slot's timers ahead of any
+ * from later laps around the wheel.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <current.h>
+#include <timer.h>
+
+#define TIMER_SLOT(deadline) ((deadline) >> TIMER_SLOTSHIFT)
+#define TIMER_INDEX(slot) ((unsigned)(slot) % TIMER_WHEELSIZE)
+
+void
+timer_bootstrap(struct timerwheel *tw)
+{
+	unsigned i;
+
+	spinlock_init(&tw->tw_lock);
+	for (i=0; i<TIMER_WHEELSIZE; i++) {
+		tw->tw_slots[i] = NULL;
+	}
+	tw->tw_runslot = 0;
+	tw->tw_count = 0;
+	tw->tw_running = NULL;
+}
+
+void
+timer_init(struct timer *t, timer_func func, void *data)
+{
+	t->tm_deadline = 0;
+	t->tm_func = func;
+	t->tm_data = data;
+	t->tm_cpu = NULL;
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+}
+
+static
+void
+timer_unlink(struct timerwheel *tw, struct timer *t)
+{
+	KASSERT(spinlock_do_i_hold(&tw->tw_lock));
+	KASSERT(t->tm_prevp != NULL);
+
+	*t->tm_prevp = t->tm_next;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = t->tm_prevp;
+	}
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	tw->tw_count--;
+}
+
+void
+timer_add(struct timer *t, uint64_t deadline)
+{
+	struct timerwheel *tw;
+	struct timer **pp;
+	uint64_t slot;
+
+	KASSERT(t->tm_prevp == NULL);
+
+	tw = &curcpu->c_timers;
+	spinlock_acquire(&tw->tw_lock);
+
+	t->tm_deadline = deadline;
+	t->tm_cpu = curcpu->c_self;
+
+	slot = TIMER_SLOT(deadline);
+	if (slot < tw->tw_runslot) {
+		slot = tw->tw_runslot;
+	}
+	pp = &tw->tw_slots[TIMER_INDEX(slot)];
+	while (*pp != NULL && (*pp)->tm_deadline <= deadline) {
+		pp = &(*pp)->tm_next;
+	}
+	t->tm_next = *pp;
+	t->tm_prevp = pp;
+	if (*pp != NULL) {
+		(*pp)->tm_prevp = &t->tm_next;
+	}
+	*pp = t;
+	tw->tw_count++;
+
+	spinlock_release(&tw->tw_lock);
+
+	/* Make sure the timer interrupt comes soon enough. */
+	hardclock_reprogram();
+}
+
+bool
+timer_cancel(struct timer *t)
+{
+	struct timerwheel *tw;
+
+	if (t->tm_cpu == NULL) {
+		/* Never added. */
+		return false;
+	}
+	tw = &t->tm_cpu->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	if (t->tm_prevp != NULL) {
+		timer_unlink(tw, t);
+		spinlock_release(&tw->tw_lock);
+		return true;
+	}
+	while (tw->tw_running == t) {
+		spinlock_release(&tw->tw_lock);
+		/* Firing on its cpu; it's short, so just wait. */
+		spinlock_acquire(&tw->tw_lock);
+	}
+	spinlock_release(&tw->tw_lock);
+	return false;
+}
+
+/*
+ * Called from hardclock with interrupts off.
+ */
+void
+timer_run(uint64_t now)
+{
+	struct timerwheel *tw = &curcpu->c_timers;
+	struct timer *t;
+	uint64_t slot, nowslot;
+	unsigned n;
+
+	nowslot = TIMER_SLOT(now);
+
+	spinlock_acquire(&tw->tw_lock);
+	if (tw->tw_count == 0) {
+		tw->tw_runslot = nowslot;
+		spinlock_release(&tw->tw_lock);
+		return;
+	}
+
+	/*
+	 * Look at every slot we've passed since last time, but at
+	 * most once around the wheel. Everything due is at the head
+	 * of its slot.
+	 */
+	slot = tw->tw_runslot;
+	for (n=0; n<TIMER_WHEELSIZE && slot <= nowslot; n++, slot++) {
+		while ((t = tw->tw_slots[TIMER_INDEX(slot)]) != NULL &&
+		       t->tm_deadline <= now) {
+			timer_unlink(tw, t);
+			tw->tw_running = t;
+			spinlock_release(&tw->tw_lock);
+
+			t->tm_func(t->tm_data);
+
+			spinlock_acquire(&tw->tw_lock);
+			tw->tw_running = NULL;
+		}
+	}
+	tw->tw_runslot = nowslot;
+	spinlock_release(&tw->tw_lock);
+}
+
+uint64_t
+timer_next(void)
+{
+	struct timerwheel *tw = &curcpu->c_timers;
+	struct timer *t;
+	uint64_t slot, next;
+	unsigned n, i;
+
+	spinlock_acquire(&tw->tw_lock);
+	next = TIMER_NEVER;
+	if (tw->tw_count == 0) {
+		spinlock_release(&tw->tw_lock);
+		return next;
+	}
+
+	/*
+	 * Going forward from the run slot, the first slot with a timer
+	 * belonging to this lap has the earliest one at its head.
+	 */
+	slot = tw->tw_runslot;
+	for (n=0; n<TIMER_WHEELSIZE; n++, slot++) {
+		t = tw->tw_slots[TIMER_INDEX(slot)];
+		if (t != NULL && TIMER_SLOT(t->tm_deadline) <= slot) {
+			next = t->tm_deadline;
+			break;
+		}
+	}
+
+	/* Nothing within one lap: take the earliest head. */
+	if (next == TIMER_NEVER) {
+		for (i=0; i<TIMER_WHEELSIZE; i++) {
+			t = tw->tw_slots[i];
+			if (t != NULL && t->tm_deadline < next) {
+				next = t->tm_deadline;
+			}
+		}
+	}
+	spinlock_release(&tw->tw_lock);
+	return next;
+}
@@ -0,0 +1,285 @@
+/*
+ * Block request queue and its scheduling policies.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <blkq.h>
+
+struct blkq_policy {
+	const char *bp_name;
+	void (*bp_add)(struct blkq *, struct blkq_req *);
+	struct blkq_req *(*bp_next)(struct blkq *, uint32_t headpos);
+};
+
+/*
+ * Unlink the request at *PP.
+ */
+static
+struct blkq_req *
+blkq_unlink(struct blkq *bq, struct blkq_req **pp)
+{
+	struct blkq_req *br = *pp;
+
+	*pp = br->br_next;
+	br->br_next = NULL;
+	KASSERT(bq->bq_depth > 0);
+	bq->bq_depth--;
+	return br;
+}
+
+/*
+ * FIFO.
+ */
+
+static
+void
+fifo_add(struct blkq *bq, struct blkq_req *br)
+{
+	struct blkq_req **pp;
+
+	for (pp = &bq->bq_reqs; *pp != NULL; pp = &(*pp)->br_next) {
+		/* nothing */
+	}
+	*pp = br;
+}
+
+static
+struct blkq_req *
+fifo_next(struct blkq *bq, uint32_t headpos)
+{
+	struct blkq_req **pp;
+
+	/* Keep a sequential stream going if there is one. */
+	for (pp = &bq->bq_reqs; *pp != NULL; pp = &(*pp)->br_next) {
+		if ((*pp)->br_block == headpos) {
+			return blkq_unlink(bq, pp);
+		}
+	}
+	return blkq_unlink(bq, &bq->bq_reqs);
+}
+
+/*
+ * C-LOOK. The list is kept sorted by block number, requests for the
+ * same block in arrival order.
+ */
+
+static
+void
+clook_add(struct blkq *bq, struct blkq_req *br)
+{
+	struct blkq_req **pp;
+
+	for (pp = &bq->bq_reqs; *pp != NULL; pp = &(*pp)->br_next) {
+		if ((*pp)->br_block > br->br_block) {
+			break;
+		}
+	}
+	br->br_next = *pp;
+	*pp = br;
+}
+
+static
+struct blkq_req *
+clook_next(struct blkq *bq, uint32_t headpos)
+{
+	struct blkq_req **pp;
+
+	for (pp = &bq->bq_reqs; *pp != NULL; pp = &(*pp)->br_next) {
+		if ((*pp)->br_block >= headpos) {
+			return blkq_unlink(bq, pp);
+		}
+	}
+	/* Nothing ahead of the head; sweep back to the start. */
+	return blkq_unlink(bq, &bq->bq_reqs);
+}
+
+/*
+ * Deadline: C-LOOK order, unless something has waited too long.
+ */
+
+static
+bool
+deadline_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static
+struct blkq_req *
+deadline_next(struct blkq *bq, uint32_t headpos)
+{
+	struct blkq_req **pp, **oldest = NULL;
+	struct timespec now;
+
+	gettime(&now);
+	for (pp = &bq->bq_reqs; *pp != NULL; pp = &(*pp)->br_next) {
+		if (deadline_before(&now, &(*pp)->br_deadline)) {
+			continue;
+		}
+		if (oldest == NULL || deadline_before(&(*pp)->br_deadline,
+						      &(*oldest)->br_deadline)) {
+			oldest = pp;
+		}
+	}
+	if (oldest != NULL) {
+		bq->bq_nexpired++;
+		return blkq_unlink(bq, oldest);
+	}
+	return clook_next(bq, headpos);
+}
+
+static const struct blkq_policy blkq_policies[] = {
+	{ "fifo",	fifo_add,	fifo_next },
+	{ "clook",	clook_add,	clook_next },
+	{ "deadline",	clook_add,	deadline_next },
+};
+
+/*
+ * Histogram bucket for V: 0, 1, 2-3, 4-7, ..., with everything past
+ * the end in the last bucket.
+ */
+static
+unsigned
+blkq_bucket(unsigned v)
+{
+	unsigned b = 0;
+
+	while (v > 0 && b < BLKQ_NBUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void
+blkq_init(struct blkq *bq)
+{
+	unsigned i;
+	int result;
+
+	bq->bq_policy = NULL;
+	bq->bq_reqs = NULL;
+	bq->bq_depth = 0;
+	for (i = 0; i < BLKQ_NBUCKETS; i++) {
+		bq->bq_depthhist[i] = 0;
+		bq->bq_lathist[i] = 0;
+	}
+	bq->bq_nexpired = 0;
+
+	result = blkq_setpolicy(bq, BLKQ_DEFAULT_POLICY);
+	KASSERT(result == 0);
+}
+
+int
+blkq_setpolicy(struct blkq *bq, const char *name)
+{
+	const struct blkq_policy *bp = NULL;
+	struct blkq_req *reqs, *br;
+	unsigned i;
+
+	for (i = 0; i < ARRAYCOUNT(blkq_policies); i++) {
+		if (!strcmp(blkq_policies[i].bp_name, name)) {
+			bp = &blkq_policies[i];
+			break;
+		}
+	}
+	if (bp == NULL) {
+		return EINVAL;
+	}
+
+	/* Requeue anything waiting in the new policy's order. */
+	reqs = bq->bq_reqs;
+	bq->bq_reqs = NULL;
+	bq->bq_policy = bp;
+	while (reqs != NULL) {
+		br = reqs;
+		reqs = br->br_next;
+		br->br_next = NULL;
+		bp->bp_add(bq, br);
+	}
+	return 0;
+}
+
+void
+blkq_add(struct blkq *bq, struct blkq_req *br, uint32_t block, bool write)
+{
+	struct timespec wait;
+	unsigned ms;
+
+	br->br_next = NULL;
+	br->br_block = block;
+	br->br_write = write;
+	gettime(&br->br_queued);
+
+	ms = write ? BLKQ_WRITE_DEADLINE : BLKQ_READ_DEADLINE;
+	wait.tv_sec = ms / 1000;
+	wait.tv_nsec = (ms % 1000) * 1000000;
+	timespec_add(&br->br_queued, &wait, &br->br_deadline);
+
+	bq->bq_depthhist[blkq_bucket(bq->bq_depth)]++;
+	bq->bq_policy->bp_add(bq, br);
+	bq->bq_depth++;
+}
+
+struct blkq_req *
+blkq_next(struct blkq *bq, uint32_t headpos)
+{
+	if (bq->bq_reqs == NULL) {
+		return NULL;
+	}
+	return bq->bq_policy->bp_next(bq, headpos);
+}
+
+void
+blkq_done(struct blkq *bq, struct blkq_req *br)
+{
+	struct timespec now, lat;
+	unsigned ms;
+
+	gettime(&now);
+	timespec_sub(&now, &br->br_queued, &lat);
+	ms = lat.tv_sec * 1000 + lat.tv_nsec / 1000000;
+	bq->bq_lathist[blkq_bucket(ms)]++;
+}
+
+/*
+ * Print one histogram, one bucket per line.
+ */
+static
+void
+blkq_printhist(const char *what, const char *unit, const unsigned *hist)
+{
+	unsigned i;
+
+	kprintf("    %s:\n", what);
+	for (i = 0; i < BLKQ_NBUCKETS; i++) {
+		if (i == 0) {
+			kprintf("      %11u %s", 0, unit);
+		}
+		else if (i == BLKQ_NBUCKETS - 1) {
+			kprintf("      %5u+      %s", 1U << (i - 1), unit);
+		}
+		else {
+			kprintf("      %5u-%-5u %s", 1U << (i - 1),
+				(1U << i) - 1, unit);
+		}
+		kprintf(" %8u\n", hist[i]);
+	}
+}
+
+/*
+ * The counts are read without the driver's lock, so they may be a
+ * request or two out of date.
+ */
+void
+blkq_printstats(struct blkq *bq)
+{
+	kprintf("    scheduler %s, %u waiting, %u served past deadline\n",
+		bq->bq_policy->bp_name, bq->bq_depth, bq->bq_nexpired);
+	blkq_printhist("queue depth on arrival", "reqs", bq->bq_depthhist);
+	blkq_printhist("latency", "ms  ", bq->bq_lathist);
+}
@@ -553,6 +553,35 @@ vfs_mount(const char *devname, void *data,
 	return 0;
 }
 
+/*
+ * Select the I/O scheduler for a mountable device.
+ */
+int
+vfs_setsched(const char *devname, const char *schedname)
+{
+	struct knowndev *kd;
+	int result;
+
+	vfs_biglock_acquire();
+
+	result = findmount(devname, &kd);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+	KASSERT(kd->kd_device != NULL);
+
+	if (kd->kd_device->d_ops->devop_setsched == NULL) {
+		vfs_biglock_release();
+		return ENOTSUP;
+	}
+	result = kd->kd_device->d_ops->devop_setsched(kd->kd_device,
+						      schedname);
+
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Unmount a filesystem/device by name.
  * First calls FSOP_SYNC on the filesystem; then calls FSOP_UNMOUNT.
@@ -665,3 +694,28 @@ vfs_unmountall(void)
 
 	return 0;
 }
+
+/*
+ * Print statistics for each device that has a devop_printstats.
+ */
+void
+vfs_printdevstats(void)
+{
+	struct knowndev *dev;
+	unsigned i, num;
+
+	vfs_biglock_acquire();
+
+	num = knowndevarray_num(knowndevs);
+	for (i=0; i<num; i++) {
+		dev = knowndevarray_get(knowndevs, i);
+		if (dev->kd_device == NULL ||
+		    dev->kd_device->d_ops->devop_printstats == NULL) {
+			continue;
+		}
+		kprintf("%s:\n", dev->kd_name);
+		dev->kd_device->d_ops->devop_printstats(dev->kd_device);
+	}
+
+	vfs_biglock_release();
+}
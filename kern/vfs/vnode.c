@@ -50,6 +50,8 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
 	spinlock_init(&vn->vn_countlock);
+	vn->vn_textgen = 0;
+	vn->vn_textcached = false;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -29,10 +29,17 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
 #include <lib.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <synch.h>
+#include <swap.h>
+#include <uio.h>
+#include <vnode.h>
+#include <textcache.h>
 #include <machine/tlb.h>
 #include <spl.h>
 
@@ -54,9 +61,18 @@ as_create(void)
 	/*
 	 * Initialize as needed.
 	 */
-	struct pagetable_entry* new_page = (struct pagetable_entry*) kmalloc(sizeof(struct pagetable_entry));
-	new_page->next = NULL;
-	as->pages=new_page;
+	as->pagetable = kmalloc(PT_NENTRIES * sizeof(uint32_t *));
+	if (as->pagetable == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	bzero(as->pagetable, PT_NENTRIES * sizeof(uint32_t *));
+	as->as_lock = lock_create("as");
+	if (as->as_lock == NULL) {
+		kfree(as->pagetable);
+		kfree(as);
+		return NULL;
+	}
 	as->regionlist=NULL;
 	as->heap_start=0;
 	as->heap_end=0;
@@ -69,51 +85,89 @@ int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *newas;
+	struct regions *oldreg, *newreg, **tail;
+	uint32_t *leaf, pte;
+	vaddr_t va;
+	off_t swapaddr;
+	unsigned i, j;
+	int result;
 
 	newas = as_create();
 	if (newas==NULL) {
 		return ENOMEM;
 	}
 
-	//Copy the pagetable
-	struct pagetable_entry *pagelist = old->pages;
-	while(pagelist!=NULL){
-		struct pagetable_entry *newpage = (struct pagetable_entry *)kmalloc(sizeof(struct pagetable_entry));
-		newpage = pagelist;
-		newpage->next=NULL;
-		if(newas->pages==NULL){
-			newas->pages = newpage;
+	//Copy the regions
+	tail = &newas->regionlist;
+	for (oldreg = old->regionlist; oldreg != NULL; oldreg = oldreg->next) {
+		newreg = kmalloc(sizeof(struct regions));
+		if (newreg == NULL) {
+			as_destroy(newas);
+			return ENOMEM;
 		}
-		else{
-			struct pagetable_entry *page_pos = newas->pages;
-			while(page_pos->next!=NULL){
-				page_pos=page_pos->next;
-			}
-			page_pos->next = newpage;
+		*newreg = *oldreg;
+		newreg->next = NULL;
+		if (newreg->vn != NULL) {
+			VOP_INCREF(newreg->vn);
 		}
-		pagelist=pagelist->next;
+		*tail = newreg;
+		tail = &newreg->next;
 	}
 
-	//Copy the regions
-	struct regions *region_list = old->regionlist;
-	while(region_list!=NULL){
-		struct regions *newregion = (struct regions *)kmalloc(sizeof(struct regions));
-		newregion = region_list;
-		newregion->next=NULL;
-		if(newas->regionlist==NULL){
-			newas->regionlist = newregion;
-		}
-		else{
-			struct regions *reg_pos = newas->regionlist;
-			while(reg_pos->next!=NULL){
-				reg_pos=reg_pos->next;
+	//Share the resident pages copy-on-write; copy the swapped ones
+	lock_acquire(old->as_lock);
+	for (i = 0; i < PT_NENTRIES; i++) {
+		leaf = old->pagetable[i];
+		if (leaf == NULL) {
+			continue;
+		}
+		for (j = 0; j < PT_NENTRIES; j++) {
+			pte = leaf[j];
+			va = (i << 22) | (j << 12);
+			if (pte & PTE_SWAPPED) {
+				result = swap_dup(pte & PTE_FRAME, &swapaddr);
+				if (result == 0) {
+					result = pte_insert(newas, va, swapaddr,
+							    pte & ~PTE_FRAME);
+					if (result) {
+						swap_free(swapaddr);
+					}
+				}
+				if (result) {
+					lock_release(old->as_lock);
+					as_destroy(newas);
+					return result;
+				}
+				continue;
+			}
+			if (!(pte & PTE_VALID)) {
+				continue;
+			}
+			if ((pte & PTE_WRITE) && !as_sharedfile(old, va)) {
+				pte |= PTE_COW;
 			}
-			reg_pos->next = newregion;
+			result = pte_insert(newas, va, pte & PTE_FRAME,
+					    pte & ~PTE_FRAME);
+			if (result) {
+				lock_release(old->as_lock);
+				as_destroy(newas);
+				return result;
+			}
+			page_share(pte & PTE_FRAME);
+			leaf[j] = pte;
 		}
-		region_list=region_list->next;
+	}
+	lock_release(old->as_lock);
+
+	/*
+	 * If we just write-protected our own pages, drop the writeable
+	 * translations the TLB may still hold for them.
+	 */
+	if (old == proc_getas()) {
+		as_activate();
 	}
 
-	//Copy stack and register
+	//Copy heap bounds
 	newas->heap_start = old->heap_start;
 	newas->heap_end = old->heap_end;
 	newas->loading = old->loading;
@@ -125,20 +179,49 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 void
 as_destroy(struct addrspace *as)
 {
+	struct regions *reg;
+	uint32_t *leaf, pte;
+	unsigned i, j;
+
+	/* Nobody is left to see an error; the file keeps what we could write. */
+	as_sync(as, NULL);
+
 	while(as->regionlist!=NULL){
-		free_kpages(as->regionlist->vbase);
-		struct regions *temp = as->regionlist;
-		kfree(temp);
-		as->regionlist = as->regionlist->next;
+		reg = as->regionlist;
+		as->regionlist = reg->next;
+		if (reg->vn != NULL) {
+			VOP_DECREF(reg->vn);
+		}
+		kfree(reg);
 	}
 
-	while(as->pages!=NULL){
-		free_kpages(as->pages->vaddr);
-		struct pagetable_entry *temp = as->pages;
-		kfree(temp);
-		as->pages = as->pages->next;
+	for (i = 0; i < PT_NENTRIES; i++) {
+		leaf = as->pagetable[i];
+		if (leaf == NULL) {
+			continue;
+		}
+		for (j = 0; j < PT_NENTRIES; j++) {
+			/*
+			 * The pageout code may be taking this very page
+			 * away; if so page_release waits for it and we
+			 * look at what it left behind.
+			 */
+			do {
+				pte = leaf[j];
+				if (pte & PTE_SWAPPED) {
+					swap_free(pte & PTE_FRAME);
+					break;
+				}
+				if (!(pte & PTE_VALID)) {
+					break;
+				}
+			} while (!page_release(pte & PTE_FRAME, as));
+		}
+		kfree(leaf);
 	}
+	kfree(as->pagetable);
 
+	lock_destroy(as->as_lock);
 	kfree(as);
 }
 
@@ -181,18 +264,16 @@ as_deactivate(void)
  * VADDR+MEMSIZE.
  *
  * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * write, or execute permission should be set on the segment.
+ * vm_fault copies them into the PTE of each page it maps.
  */
 int
 as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 		 int readable, int writeable, int executable)
 {
-	/*
-	 * Write this.
-	 */
 	size_t npages;
+	struct regions *nextregion, **tail;
+
 	/* Align the region. First, the base... */
 	memsize += vaddr & ~(vaddr_t)PAGE_FRAME;
 	vaddr &= PAGE_FRAME;
@@ -202,42 +283,79 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 
 	npages = memsize / PAGE_SIZE;
 
-	//Update heap start and end
-	if (as->heap_start < vaddr) {
-		as->heap_start = vaddr;
-		as->heap_end = vaddr+memsize;
+	//The heap starts empty just past the highest region
+	if (as->heap_start < vaddr + memsize) {
+		as->heap_start = vaddr + memsize;
+		as->heap_end = vaddr + memsize;
 	}
 
-	struct regions *nextregion;
-	if(as->regionlist==NULL){
-		as->regionlist = (struct regions *)kmalloc(sizeof(struct regions));
-		nextregion = as->regionlist;
-	}
-	else{
-		nextregion = as->regionlist;
-		while(nextregion->next!=NULL){
-			nextregion = nextregion->next;
-		}
-		nextregion->next = (struct regions *)kmalloc(sizeof(struct regions));
-		nextregion = nextregion->next;
+	nextregion = (struct regions *)kmalloc(sizeof(struct regions));
+	if (nextregion == NULL) {
+		return ENOMEM;
 	}
-
 	nextregion->vbase = vaddr;
 	nextregion->npages = npages;
-	nextregion->permissions[0] = readable;
-	nextregion->permissions[1] = writeable;
-	nextregion->permissions[3] = executable;
+	nextregion->permissions[0] = readable != 0;
+	nextregion->permissions[1] = writeable != 0;
+	nextregion->permissions[2] = executable != 0;
+	nextregion->vn = NULL;
+	nextregion->filevaddr = 0;
+	nextregion->fileoffset = 0;
+	nextregion->filesz = 0;
+	nextregion->flags = 0;
 	nextregion->next = NULL;
+
+	for (tail = &as->regionlist; *tail != NULL; tail = &(*tail)->next) {
+		/* nothing */
+	}
+	*tail = nextregion;
 	return 0;
 }
 
+static
+struct regions *
+as_findregion(struct addrspace *as, vaddr_t vaddr)
+{
+	struct regions *reg;
+
+	for (reg = as->regionlist; reg != NULL; reg = reg->next) {
+		if (vaddr >= reg->vbase &&
+		    vaddr < reg->vbase + reg->npages * PAGE_SIZE) {
+			return reg;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Nothing is read here; vm_fault calls as_fill_page for each page of
+ * the segment the first time it is touched.
+ */
 int
-as_prepare_load(struct addrspace *as)
+as_define_filedata(struct addrspace *as, vaddr_t vaddr, size_t filesz,
+		   struct vnode *vn, off_t offset)
 {
-	/*
-	 * Write this.
-	 */
+	struct regions *reg;
+
+	reg = as_findregion(as, vaddr);
+	if (reg == NULL || reg->vn != NULL) {
+		return EINVAL;
+	}
+	if (filesz > reg->vbase + reg->npages * PAGE_SIZE - vaddr) {
+		return EINVAL;
+	}
+
+	VOP_INCREF(vn);
+	reg->vn = vn;
+	reg->filevaddr = vaddr;
+	reg->fileoffset = offset;
+	reg->filesz = filesz;
+	return 0;
+}
 
+int
+as_prepare_load(struct addrspace *as)
+{
 	//Set Loading to 1. Checked during vm_fault
 	as->loading = 1;
 	return 0;
@@ -246,21 +364,20 @@ as_prepare_load(struct addrspace *as)
 int
 as_complete_load(struct addrspace *as)
 {
+	as->loading=0;
+
 	/*
-	 * Write this.
+	 * Pages of read-only segments were entered in the TLB
+	 * writable while loading; flush so they fault back in with
+	 * their real permissions.
 	 */
-
-	as->loading=0;
+	as_activate();
 	return 0;
 }
 
 int
 as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
-	/*
-	 * Write this.
-	 */
-
 	(void)as;
 
 	/* Initial user-level stack pointer */
@@ -269,47 +386,465 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
-struct pagetable_entry * get_pte(struct addrspace *as, vaddr_t vbase){
-	struct pagetable_entry *pte = as->pages;
-	if(pte==NULL)
-		return NULL;
-	
-	int v = (vbase>>12)&0xfffff;
+/*
+ * Mappings made by mmap.
+ *
+ * They go in the highest gap below the stack that fits, leaving the
+ * space just above the heap for the heap to grow into. The region
+ * list is changed only with as_lock held, since the pageout code
+ * looks at it to decide where a page of a shared mapping goes.
+ */
 
-	while(pte!=NULL){
-		int page_v = pte->vaddr;
-		if(page_v == v){
-			return pte;
+static
+struct regions *
+as_findoverlap(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+	struct regions *reg;
+	vaddr_t end = vaddr + npages * PAGE_SIZE;
+
+	for (reg = as->regionlist; reg != NULL; reg = reg->next) {
+		if (vaddr < reg->vbase + reg->npages * PAGE_SIZE &&
+		    end > reg->vbase) {
+			return reg;
 		}
+	}
+	return NULL;
+}
 
-		pte = pte->next;
+bool
+as_overlaps(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+	return as_findoverlap(as, vaddr, npages) != NULL;
+}
+
+int
+as_mmap(struct addrspace *as, size_t npages, int prot, int flags,
+	struct vnode *vn, off_t offset, size_t filesz, vaddr_t *ret)
+{
+	struct regions *reg, *newreg;
+	vaddr_t top, base;
+
+	KASSERT(npages > 0);
+	KASSERT(filesz <= npages * PAGE_SIZE);
+
+	newreg = kmalloc(sizeof(*newreg));
+	if (newreg == NULL) {
+		return ENOMEM;
 	}
 
-	return NULL;
+	lock_acquire(as->as_lock);
+	top = USERSTACK - STACKPAGES * PAGE_SIZE;
+	while (1) {
+		if (top < as->heap_end ||
+		    npages > (top - as->heap_end) / PAGE_SIZE) {
+			lock_release(as->as_lock);
+			kfree(newreg);
+			return ENOMEM;
+		}
+		base = top - npages * PAGE_SIZE;
+		reg = as_findoverlap(as, base, npages);
+		if (reg == NULL) {
+			break;
+		}
+		top = reg->vbase;
+	}
+
+	newreg->vbase = base;
+	newreg->npages = npages;
+	newreg->permissions[0] = (prot & (PROT_READ | PROT_WRITE)) != 0;
+	newreg->permissions[1] = (prot & PROT_WRITE) != 0;
+	newreg->permissions[2] = (prot & PROT_EXEC) != 0;
+	newreg->vn = vn;
+	newreg->filevaddr = base;
+	newreg->fileoffset = offset;
+	newreg->filesz = vn != NULL ? filesz : 0;
+	newreg->flags = REG_MMAP | (flags & REG_SHARED);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	newreg->next = as->regionlist;
+	as->regionlist = newreg;
+	lock_release(as->as_lock);
+
+	*ret = base;
+	return 0;
 }
 
-void pte_insert(struct addrspace *as, vaddr_t vbase, vaddr_t pbase, bool perm[3]){
-	vaddr_t v = vbase>>12;
-	vaddr_t p = pbase>>12;
-	struct pagetable_entry *newpage = (struct pagetable_entry *)kmalloc(sizeof(struct pagetable_entry));
-	newpage->vaddr = v;
-	newpage->paddr = p;
-	for(int i=0; i<3; i++)
-		newpage->permissions[i] = perm[i];
-	newpage->next = NULL;
+/*
+ * Write back the dirty pages from VADDR up to END. The unlocked look
+ * at each PTE is only a hint; page_sync checks again properly.
+ */
+static
+int
+as_syncrange(struct addrspace *as, vaddr_t vaddr, vaddr_t end)
+{
+	uint32_t *pte;
+	int result;
+
+	for (; vaddr < end; vaddr += PAGE_SIZE) {
+		pte = get_pte(as, vaddr);
+		if (pte == NULL ||
+		    (*pte & (PTE_VALID | PTE_DIRTY)) != (PTE_VALID | PTE_DIRTY)) {
+			continue;
+		}
+		result = page_sync(as, vaddr);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
 
-	struct pagetable_entry* curr = as->pages;
+int
+as_sync(struct addrspace *as, struct vnode *vn)
+{
+	struct regions *reg;
+	int result;
 
-	if(curr==NULL){
-		as->pages = newpage;
-		return;
+	for (reg = as->regionlist; reg != NULL; reg = reg->next) {
+		if (!(reg->flags & REG_SHARED) || reg->vn == NULL ||
+		    (vn != NULL && reg->vn != vn)) {
+			continue;
+		}
+		result = as_syncrange(as, reg->vbase,
+				      reg->vbase + reg->npages * PAGE_SIZE);
+		if (result) {
+			return result;
+		}
 	}
-	while(curr->next!=NULL)
-		curr=curr->next;
+	return 0;
+}
 
-	curr->next = newpage;
-	return;
+int
+as_munmap(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+	struct regions *reg, **regp, *rest = NULL, *dead = NULL;
+	vaddr_t va, end, regend;
+	uint32_t *pte, old;
+	int spl, tlb_index, result;
+
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+	KASSERT(npages > 0);
+	end = vaddr + npages * PAGE_SIZE;
+
+	for (regp = &as->regionlist; *regp != NULL; regp = &(*regp)->next) {
+		reg = *regp;
+		if (vaddr >= reg->vbase &&
+		    vaddr < reg->vbase + reg->npages * PAGE_SIZE) {
+			break;
+		}
+	}
+	reg = *regp;
+	if (reg == NULL || !(reg->flags & REG_MMAP)) {
+		return EINVAL;
+	}
+	regend = reg->vbase + reg->npages * PAGE_SIZE;
+	if (end <= vaddr || end > regend) {
+		return EINVAL;
+	}
+
+	/* Punching a hole needs a second region; get it before we start. */
+	if (vaddr > reg->vbase && end < regend) {
+		rest = kmalloc(sizeof(*rest));
+		if (rest == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	if (reg->flags & REG_SHARED) {
+		result = as_syncrange(as, vaddr, end);
+		if (result) {
+			kfree(rest);
+			return result;
+		}
+	}
+
+	/*
+	 * The file fields are absolute, so what's left of the region
+	 * still finds its data in the same place.
+	 */
+	lock_acquire(as->as_lock);
+	if (rest != NULL) {
+		*rest = *reg;
+		rest->vbase = end;
+		rest->npages = (regend - end) / PAGE_SIZE;
+		if (rest->vn != NULL) {
+			VOP_INCREF(rest->vn);
+		}
+		reg->npages = (vaddr - reg->vbase) / PAGE_SIZE;
+		reg->next = rest;
+	}
+	else if (vaddr == reg->vbase && end == regend) {
+		*regp = reg->next;
+		dead = reg;
+	}
+	else if (vaddr == reg->vbase) {
+		reg->vbase = end;
+		reg->npages -= npages;
+	}
+	else {
+		reg->npages -= npages;
+	}
+	lock_release(as->as_lock);
+
+	for (va = vaddr; va < end; va += PAGE_SIZE) {
+		lock_acquire(as->as_lock);
+		pte = get_pte(as, va);
+		old = pte != NULL ? *pte : 0;
+		if (pte != NULL) {
+			*pte = 0;
+		}
+		lock_release(as->as_lock);
+
+		/* Nothing may still reach the frame once it's freed. */
+		spl = splhigh();
+		tlb_index = tlb_probe(va, 0);
+		if (tlb_index >= 0) {
+			tlb_write(TLBHI_INVALID(tlb_index), TLBLO_INVALID(),
+				  tlb_index);
+		}
+		splx(spl);
 
+		if (old & PTE_SWAPPED) {
+			swap_free(old & PTE_FRAME);
+		}
+		else if (old & PTE_VALID) {
+			/* See as_destroy. */
+			while (!page_release(old & PTE_FRAME, as)) {
+				/* retry */
+			}
+		}
+	}
+
+	if (dead != NULL) {
+		if (dead->vn != NULL) {
+			VOP_DECREF(dead->vn);
+		}
+		kfree(dead);
+	}
+	return 0;
 }
 
+uint32_t
+as_perms(struct addrspace *as, vaddr_t vaddr)
+{
+	struct regions *reg;
+	uint32_t perms;
+
+	reg = as_findregion(as, vaddr);
+	if (reg != NULL) {
+		perms = 0;
+		if (reg->permissions[0]) {
+			perms |= PTE_READ;
+		}
+		if (reg->permissions[1]) {
+			perms |= PTE_WRITE;
+		}
+		if (reg->permissions[2]) {
+			perms |= PTE_EXEC;
+		}
+		return perms;
+	}
+
+	if (vaddr >= as->heap_start && vaddr < as->heap_end) {
+		return PTE_READ | PTE_WRITE;
+	}
 
+	if (vaddr >= USERSTACK - PAGE_SIZE * STACKPAGES && vaddr < USERSTACK) {
+		return PTE_READ | PTE_WRITE;
+	}
+
+	return 0;
+}
+
+/*
+ * A page can be shared with other processes running the same file if
+ * every region it overlaps is read-only and whatever part of it comes
+ * from a file comes from that one. Return the file, or NULL.
+ */
+struct vnode *
+as_textvnode(struct addrspace *as, vaddr_t vaddr)
+{
+	struct regions *reg;
+	struct vnode *vn = NULL;
+	vaddr_t end;
+
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+
+	for (reg = as->regionlist; reg != NULL; reg = reg->next) {
+		end = reg->vbase + reg->npages * PAGE_SIZE;
+		if (vaddr + PAGE_SIZE <= reg->vbase || vaddr >= end) {
+			continue;
+		}
+		/* Mappings needn't be at the same place in everyone. */
+		if (reg->permissions[1] || (reg->flags & REG_MMAP)) {
+			return NULL;
+		}
+		if (reg->vn == NULL) {
+			continue;
+		}
+		if (vn != NULL && vn != reg->vn) {
+			return NULL;
+		}
+		vn = reg->vn;
+	}
+	return vn;
+}
+
+uint32_t *
+get_pte(struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t *leaf;
+
+	leaf = as->pagetable[PT_DIRINDEX(vaddr)];
+	if (leaf == NULL) {
+		return NULL;
+	}
+	return &leaf[PT_LEAFINDEX(vaddr)];
+}
+
+int
+pte_insert(struct addrspace *as, vaddr_t vaddr, paddr_t paddr, uint32_t flags)
+{
+	uint32_t **slot, *leaf;
+
+	KASSERT((paddr & ~PTE_FRAME) == 0);
+	KASSERT((flags & PTE_FRAME) == 0);
+
+	slot = &as->pagetable[PT_DIRINDEX(vaddr)];
+	if (*slot == NULL) {
+		leaf = kmalloc(PT_NENTRIES * sizeof(uint32_t));
+		if (leaf == NULL) {
+			return ENOMEM;
+		}
+		bzero(leaf, PT_NENTRIES * sizeof(uint32_t));
+		*slot = leaf;
+	}
+	(*slot)[PT_LEAFINDEX(vaddr)] = paddr | flags;
+	return 0;
+}
+
+/*
+ * Every segment is checked, not just the region the page falls in,
+ * since two segments may share a page at their ends.
+ *
+ * The region list is walked without as_lock. Only the process's own
+ * thread changes it, and that's the one faulting; other threads (the
+ * pageout code) only read it.
+ */
+int
+as_fill_page(struct addrspace *as, vaddr_t vaddr, paddr_t paddr)
+{
+	struct regions *reg;
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t start, end;
+	char *kva = (char *)PADDR_TO_KVADDR(paddr);
+	int result;
+
+	KASSERT(!lock_do_i_hold(as->as_lock));
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+
+	bzero(kva, PAGE_SIZE);
+
+	for (reg = as->regionlist; reg != NULL; reg = reg->next) {
+		if (reg->vn == NULL) {
+			continue;
+		}
+
+		/* The part of this page that comes from the file. */
+		start = vaddr > reg->filevaddr ? vaddr : reg->filevaddr;
+		end = vaddr + PAGE_SIZE;
+		if (end > reg->filevaddr + reg->filesz) {
+			end = reg->filevaddr + reg->filesz;
+		}
+		if (start >= end) {
+			continue;
+		}
+
+		uio_kinit(&iov, &ku, kva + (start - vaddr), end - start,
+			  reg->fileoffset + (start - reg->filevaddr),
+			  UIO_READ);
+		result = VOP_READ(reg->vn, &ku);
+		if (result) {
+			return result;
+		}
+		if (ku.uio_resid != 0 && !(reg->flags & REG_MMAP)) {
+			/* The executable shrank under us. */
+			return ENOEXEC;
+		}
+	}
+	return 0;
+}
+
+bool
+as_sharedfile(struct addrspace *as, vaddr_t vaddr)
+{
+	struct regions *reg;
+
+	reg = as_findregion(as, vaddr);
+	return reg != NULL && (reg->flags & REG_SHARED) && reg->vn != NULL;
+}
+
+/*
+ * Only the part of the page inside the file as it was mapped goes
+ * back, and never past the file's current end, so a mapping never
+ * makes the file grow. The region is looked at with as_lock held;
+ * then the lock is dropped for the write, with a reference on the
+ * vnode so it can't go away if the region is unmapped meanwhile.
+ */
+int
+as_writeback(struct addrspace *as, vaddr_t vaddr, paddr_t paddr)
+{
+	struct regions *reg;
+	struct vnode *vn;
+	struct stat st;
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t start, end;
+	off_t offset;
+	int result;
+
+	KASSERT(lock_do_i_hold(as->as_lock));
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+
+	reg = as_findregion(as, vaddr);
+	KASSERT(reg != NULL && (reg->flags & REG_SHARED) && reg->vn != NULL);
+
+	start = vaddr > reg->filevaddr ? vaddr : reg->filevaddr;
+	end = vaddr + PAGE_SIZE;
+	if (end > reg->filevaddr + reg->filesz) {
+		end = reg->filevaddr + reg->filesz;
+	}
+	if (start >= end) {
+		lock_release(as->as_lock);
+		return 0;
+	}
+	offset = reg->fileoffset + (start - reg->filevaddr);
+	vn = reg->vn;
+	VOP_INCREF(vn);
+	lock_release(as->as_lock);
+
+	result = VOP_STAT(vn, &st);
+	if (result) {
+		goto out;
+	}
+	if (offset >= st.st_size) {
+		goto out;
+	}
+	if (offset + (off_t)(end - start) > st.st_size) {
+		end = start + (st.st_size - offset);
+	}
+
+	uio_kinit(&iov, &ku, (char *)PADDR_TO_KVADDR(paddr) + (start - vaddr),
+		  end - start, offset, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	textcache_invalidate(vn);
+	if (result == 0 && ku.uio_resid != 0) {
+		result = EIO;
+	}
+
+ out:
+	VOP_DECREF(vn);
+	return result;
+}
@@ -0,0 +1,223 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <bitmap.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <vm.h>
+#include <swap.h>
+
+/*
+ * Swap space management.
+ *
+ * The slot bitmap is protected by a spinlock rather than a sleep lock
+ * so that frames can give up their swap copies while the coremap lock
+ * is held. The I/O itself goes straight to the device vnode; the disk
+ * driver does its own serialization.
+ */
+
+static struct vnode *swap_vnode;
+static struct bitmap *swap_map;
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+static unsigned swap_nslots;
+static unsigned swap_used;
+static unsigned swap_npageins;
+static unsigned swap_npageouts;
+
+void
+swap_bootstrap(void)
+{
+	char path[sizeof(SWAP_DEVICE)];
+	struct stat st;
+	int result;
+
+	strcpy(path, SWAP_DEVICE);
+	result = vfs_open(path, O_RDWR, 0, &swap_vnode);
+	if (result) {
+		kprintf("swap: %s: %s; running without swap\n",
+			SWAP_DEVICE, strerror(result));
+		swap_vnode = NULL;
+		return;
+	}
+
+	result = VOP_STAT(swap_vnode, &st);
+	if (result) {
+		panic("swap: stat %s: %s\n", SWAP_DEVICE, strerror(result));
+	}
+	swap_nslots = st.st_size / PAGE_SIZE;
+	if (swap_nslots < 2) {
+		kprintf("swap: %s is too small; running without swap\n",
+			SWAP_DEVICE);
+		vfs_close(swap_vnode);
+		swap_vnode = NULL;
+		return;
+	}
+
+	result = vfs_setsched(SWAP_DISK, SWAP_SCHED);
+	if (result) {
+		kprintf("swap: scheduler %s: %s\n", SWAP_SCHED,
+			strerror(result));
+	}
+
+	swap_map = bitmap_create(swap_nslots);
+	if (swap_map == NULL) {
+		panic("swap: Out of memory for slot bitmap\n");
+	}
+	/* Slot 0 is never used; a swap address of 0 means none. */
+	bitmap_mark(swap_map, 0);
+
+	kprintf("swap: %u pages on %s\n", swap_nslots - 1, SWAP_DEVICE);
+}
+
+int
+swap_alloc(off_t *swapaddr)
+{
+	unsigned slot;
+	int result;
+
+	if (swap_map == NULL) {
+		return ENOSPC;
+	}
+
+	spinlock_acquire(&swap_lock);
+	result = bitmap_alloc(swap_map, &slot);
+	if (result == 0) {
+		swap_used++;
+	}
+	spinlock_release(&swap_lock);
+	if (result) {
+		return ENOSPC;
+	}
+
+	*swapaddr = (off_t)slot * PAGE_SIZE;
+	return 0;
+}
+
+void
+swap_free(off_t swapaddr)
+{
+	unsigned slot = swapaddr / PAGE_SIZE;
+
+	KASSERT(swapaddr % PAGE_SIZE == 0);
+	KASSERT(slot > 0 && slot < swap_nslots);
+
+	spinlock_acquire(&swap_lock);
+	KASSERT(bitmap_isset(swap_map, slot));
+	bitmap_unmark(swap_map, slot);
+	swap_used--;
+	spinlock_release(&swap_lock);
+}
+
+/*
+ * Move one page between physical memory and the swap device.
+ */
+static
+int
+swap_io(paddr_t paddr, off_t swapaddr, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(swap_vnode != NULL);
+	KASSERT(swapaddr > 0 && swapaddr % PAGE_SIZE == 0);
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  swapaddr, rw);
+	if (rw == UIO_READ) {
+		result = VOP_READ(swap_vnode, &ku);
+	}
+	else {
+		result = VOP_WRITE(swap_vnode, &ku);
+	}
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return EIO;
+	}
+	return 0;
+}
+
+int
+swap_pagein(paddr_t paddr, off_t swapaddr)
+{
+	int result;
+
+	result = swap_io(paddr, swapaddr, UIO_READ);
+	if (result == 0) {
+		spinlock_acquire(&swap_lock);
+		swap_npageins++;
+		spinlock_release(&swap_lock);
+	}
+	return result;
+}
+
+int
+swap_pageout(paddr_t paddr, off_t swapaddr)
+{
+	int result;
+
+	result = swap_io(paddr, swapaddr, UIO_WRITE);
+	if (result == 0) {
+		spinlock_acquire(&swap_lock);
+		swap_npageouts++;
+		spinlock_release(&swap_lock);
+	}
+	return result;
+}
+
+int
+swap_dup(off_t swapaddr, off_t *ret)
+{
+	vaddr_t buf;
+	off_t newaddr;
+	int result;
+
+	result = swap_alloc(&newaddr);
+	if (result) {
+		return result;
+	}
+	buf = alloc_kpages(1);
+	if (buf == 0) {
+		swap_free(newaddr);
+		return ENOMEM;
+	}
+
+	result = swap_pagein(KVADDR_TO_PADDR(buf), swapaddr);
+	if (result == 0) {
+		result = swap_pageout(KVADDR_TO_PADDR(buf), newaddr);
+	}
+	free_kpages(buf);
+	if (result) {
+		swap_free(newaddr);
+		return result;
+	}
+
+	*ret = newaddr;
+	return 0;
+}
+
+void
+swap_printstats(void)
+{
+	unsigned used, ins, outs;
+
+	if (swap_map == NULL) {
+		kprintf("swap: not configured\n");
+		return;
+	}
+
+	spinlock_acquire(&swap_lock);
+	used = swap_used;
+	ins = swap_npageins;
+	outs = swap_npageouts;
+	spinlock_release(&swap_lock);
+
+	kprintf("swap: %u of %u pages in use, %u page-ins, %u page-outs\n",
+		used, swap_nslots - 1, ins, outs);
+}
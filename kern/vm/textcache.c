@@ -0,0 +1,320 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vnode.h>
+#include <vm.h>
+#include <textcache.h>
+
+/*
+ * Shared text pages. See <textcache.h>.
+ *
+ * Pages are hashed on (vnode, vaddr). Each cached file also gets a
+ * tc_file record, which holds the vnode reference and counts its
+ * pages.
+ *
+ * textcache_invalidate is called on every write, so it doesn't take
+ * tc_lock unless the file has pages cached. Instead it bumps the
+ * vnode's vn_textgen and looks at vn_textcached, under the vnode's
+ * own lock. An insert checks the generation its caller saw before
+ * reading the page against vn_textgen, and sets vn_textcached, under
+ * that same lock while holding tc_lock. So either the insert sees the
+ * write's new generation and drops the page, or the write sees the
+ * file is cached and waits for tc_lock to take the page out again.
+ *
+ * tc_lock is a spinlock and is taken before the coremap lock (by way
+ * of page_share) and before vnodes' vn_countlock. Nothing that can
+ * sleep - dropping frames, vnode references, or entries - is done
+ * while holding it.
+ */
+
+#define TC_HASHSIZE 128
+#define TC_HASH(vn, vaddr) \
+	((((uintptr_t)(vn) / sizeof(void *)) + (vaddr) / PAGE_SIZE) % TC_HASHSIZE)
+
+struct tc_file {
+	struct vnode *tf_vn;
+	unsigned tf_npages;
+	struct tc_file *tf_next;
+};
+
+struct tc_page {
+	struct tc_file *tp_file;
+	vaddr_t tp_vaddr;
+	paddr_t tp_paddr;
+	struct tc_page *tp_next;
+};
+
+static struct tc_page *tc_hash[TC_HASHSIZE];
+static struct tc_file *tc_files;
+static struct spinlock tc_lock = SPINLOCK_INITIALIZER;
+static unsigned tc_trimhand;		/* next bucket textcache_trim looks at */
+static unsigned tc_npages;
+static unsigned tc_hits;
+static unsigned tc_inserts;
+static unsigned tc_trimmed;
+
+static
+struct tc_file *
+tc_findfile(struct vnode *vn)
+{
+	struct tc_file *tf;
+
+	KASSERT(spinlock_do_i_hold(&tc_lock));
+
+	for (tf = tc_files; tf != NULL; tf = tf->tf_next) {
+		if (tf->tf_vn == vn) {
+			return tf;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Unlink *TPP, which belongs to a file, and put it on *DEAD. If that
+ * was the file's last page, the file record goes on *DEADFILES.
+ */
+static
+void
+tc_unlink(struct tc_page **tpp, struct tc_page **dead,
+	  struct tc_file **deadfiles)
+{
+	struct tc_page *tp = *tpp;
+	struct tc_file *tf = tp->tp_file, **tfp;
+
+	KASSERT(spinlock_do_i_hold(&tc_lock));
+
+	*tpp = tp->tp_next;
+	tp->tp_next = *dead;
+	*dead = tp;
+	tc_npages--;
+
+	KASSERT(tf->tf_npages > 0);
+	if (--tf->tf_npages > 0) {
+		return;
+	}
+	spinlock_acquire(&tf->tf_vn->vn_countlock);
+	tf->tf_vn->vn_textcached = false;
+	spinlock_release(&tf->tf_vn->vn_countlock);
+	for (tfp = &tc_files; *tfp != tf; tfp = &(*tfp)->tf_next) {
+		KASSERT(*tfp != NULL);
+	}
+	*tfp = tf->tf_next;
+	tf->tf_next = *deadfiles;
+	*deadfiles = tf;
+}
+
+/*
+ * Drop the cache's references held by entries unlinked by tc_unlink.
+ */
+static
+void
+tc_release(struct tc_page *dead, struct tc_file *deadfiles)
+{
+	struct tc_page *tp;
+	struct tc_file *tf;
+
+	while (dead != NULL) {
+		tp = dead;
+		dead = tp->tp_next;
+		while (!page_release(tp->tp_paddr, NULL)) {
+			/* retry */
+		}
+		kfree(tp);
+	}
+	while (deadfiles != NULL) {
+		tf = deadfiles;
+		deadfiles = tf->tf_next;
+		VOP_DECREF(tf->tf_vn);
+		kfree(tf);
+	}
+}
+
+paddr_t
+textcache_lookup(struct vnode *vn, vaddr_t vaddr)
+{
+	struct tc_page *tp;
+	paddr_t paddr = 0;
+
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+
+	spinlock_acquire(&tc_lock);
+	for (tp = tc_hash[TC_HASH(vn, vaddr)]; tp != NULL; tp = tp->tp_next) {
+		if (tp->tp_file->tf_vn == vn && tp->tp_vaddr == vaddr) {
+			/* Our reference keeps it alive until this one is in. */
+			page_share(tp->tp_paddr);
+			paddr = tp->tp_paddr;
+			tc_hits++;
+			break;
+		}
+	}
+	spinlock_release(&tc_lock);
+	return paddr;
+}
+
+unsigned
+textcache_generation(struct vnode *vn)
+{
+	unsigned gen;
+
+	spinlock_acquire(&vn->vn_countlock);
+	gen = vn->vn_textgen;
+	spinlock_release(&vn->vn_countlock);
+	return gen;
+}
+
+void
+textcache_insert(struct vnode *vn, vaddr_t vaddr, paddr_t paddr,
+		 unsigned gen)
+{
+	struct tc_page *tp, *newtp;
+	struct tc_file *tf, *newtf;
+	unsigned h = TC_HASH(vn, vaddr);
+
+	KASSERT((vaddr & ~PAGE_FRAME) == 0);
+
+	newtp = kmalloc(sizeof(*newtp));
+	newtf = kmalloc(sizeof(*newtf));
+	if (newtp == NULL || newtf == NULL) {
+		/* Just don't share this one. */
+		kfree(newtp);
+		kfree(newtf);
+		return;
+	}
+
+	spinlock_acquire(&tc_lock);
+	for (tp = tc_hash[h]; tp != NULL; tp = tp->tp_next) {
+		if (tp->tp_file->tf_vn == vn && tp->tp_vaddr == vaddr) {
+			/* Someone else filled it at the same time. */
+			spinlock_release(&tc_lock);
+			kfree(newtp);
+			kfree(newtf);
+			return;
+		}
+	}
+
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_textgen != gen) {
+		/* Written since the page was read; it may be stale. */
+		spinlock_release(&vn->vn_countlock);
+		spinlock_release(&tc_lock);
+		kfree(newtp);
+		kfree(newtf);
+		return;
+	}
+	vn->vn_textcached = true;
+	spinlock_release(&vn->vn_countlock);
+
+	tf = tc_findfile(vn);
+	if (tf == NULL) {
+		tf = newtf;
+		newtf = NULL;
+		VOP_INCREF(vn);
+		tf->tf_vn = vn;
+		tf->tf_npages = 0;
+		tf->tf_next = tc_files;
+		tc_files = tf;
+	}
+
+	page_share(paddr);
+	newtp->tp_file = tf;
+	newtp->tp_vaddr = vaddr;
+	newtp->tp_paddr = paddr;
+	newtp->tp_next = tc_hash[h];
+	tc_hash[h] = newtp;
+	tf->tf_npages++;
+	tc_npages++;
+	tc_inserts++;
+	spinlock_release(&tc_lock);
+
+	kfree(newtf);
+}
+
+void
+textcache_invalidate(struct vnode *vn)
+{
+	struct tc_page **tpp, *dead = NULL;
+	struct tc_file *deadfiles = NULL;
+	unsigned h;
+	bool cached;
+
+	spinlock_acquire(&vn->vn_countlock);
+	vn->vn_textgen++;
+	cached = vn->vn_textcached;
+	spinlock_release(&vn->vn_countlock);
+	if (!cached) {
+		return;
+	}
+
+	spinlock_acquire(&tc_lock);
+	if (tc_findfile(vn) == NULL) {
+		spinlock_release(&tc_lock);
+		return;
+	}
+	for (h = 0; h < TC_HASHSIZE; h++) {
+		tpp = &tc_hash[h];
+		while (*tpp != NULL) {
+			if ((*tpp)->tp_file->tf_vn == vn) {
+				tc_unlink(tpp, &dead, &deadfiles);
+			}
+			else {
+				tpp = &(*tpp)->tp_next;
+			}
+		}
+	}
+	spinlock_release(&tc_lock);
+
+	tc_release(dead, deadfiles);
+}
+
+unsigned
+textcache_trim(unsigned npages)
+{
+	struct tc_page **tpp, *dead = NULL;
+	struct tc_file *deadfiles = NULL;
+	unsigned n, freed = 0;
+
+	spinlock_acquire(&tc_lock);
+	for (n = 0; n < TC_HASHSIZE && freed < npages; n++) {
+		tpp = &tc_hash[tc_trimhand];
+		tc_trimhand = (tc_trimhand + 1) % TC_HASHSIZE;
+		while (*tpp != NULL && freed < npages) {
+			/*
+			 * Only lookups add references to a cached frame
+			 * nobody maps, and they hold tc_lock, so a count
+			 * of one can't change under us.
+			 */
+			if (page_refcount((*tpp)->tp_paddr) == 1) {
+				tc_unlink(tpp, &dead, &deadfiles);
+				freed++;
+			}
+			else {
+				tpp = &(*tpp)->tp_next;
+			}
+		}
+	}
+	tc_trimmed += freed;
+	spinlock_release(&tc_lock);
+
+	tc_release(dead, deadfiles);
+	return freed;
+}
+
+void
+textcache_printstats(void)
+{
+	struct tc_file *tf;
+	unsigned npages, nfiles = 0, hits, inserts, trimmed;
+
+	spinlock_acquire(&tc_lock);
+	for (tf = tc_files; tf != NULL; tf = tf->tf_next) {
+		nfiles++;
+	}
+	npages = tc_npages;
+	hits = tc_hits;
+	inserts = tc_inserts;
+	trimmed = tc_trimmed;
+	spinlock_release(&tc_lock);
+
+	kprintf("textcache: %u pages of %u files, %u hits, %u inserted, "
+		"%u trimmed\n", npages, nfiles, hits, inserts, trimmed);
+}
@@ -421,6 +421,7 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
+#ifdef HOST
 	pid = fork();
 	switch (pid) {
 		case -1:
@@ -443,6 +444,18 @@ docommand(char *buf, struct exitinfo *ei)
 		default:
 			break;
 	}
+#else
+	/*
+	 * Build the child straight from the program file instead of
+	 * copying our whole address space just to throw it away.
+	 */
+	pid = spawnp(args[0], args, NULL, 0);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+#endif
 
 	/* parent */
 	if (bg) {
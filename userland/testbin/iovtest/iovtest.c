@@ -0,0 +1,114 @@
+/*
+ * iovtest.c
+ *
+ * 	Tests readv, writev, pread, pwrite, preadv and pwritev.
+ *
+ * 	Writes header/payload records with writev, reads them back with
+ * 	readv, then checks that the positional calls hit the right place
+ * 	and leave the file offset alone.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <err.h>
+
+#define FILENAME "iovtest.dat"
+#define NRECS    16
+
+static const char header[] = "HDR:";
+static const char payload[] = "the quick brown fox\n";
+
+#define RECSIZE (sizeof(header) - 1 + sizeof(payload) - 1)
+
+int
+main(void)
+{
+	struct iovec iov[2];
+	char hbuf[sizeof(header)], pbuf[sizeof(payload)];
+	char buf[RECSIZE + 1];
+	ssize_t len;
+	off_t pos;
+	int fd, i;
+
+	fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+
+	/* writev: one syscall per record */
+	for (i = 0; i < NRECS; i++) {
+		iov[0].iov_base = (void *)header;
+		iov[0].iov_len = sizeof(header) - 1;
+		iov[1].iov_base = (void *)payload;
+		iov[1].iov_len = sizeof(payload) - 1;
+		len = writev(fd, iov, 2);
+		if (len != (ssize_t)RECSIZE) {
+			err(1, "writev: record %d: wrote %d", i, (int)len);
+		}
+	}
+
+	/* readv: split each record back into its parts */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	for (i = 0; i < NRECS; i++) {
+		memset(hbuf, 0, sizeof(hbuf));
+		memset(pbuf, 0, sizeof(pbuf));
+		iov[0].iov_base = hbuf;
+		iov[0].iov_len = sizeof(header) - 1;
+		iov[1].iov_base = pbuf;
+		iov[1].iov_len = sizeof(payload) - 1;
+		len = readv(fd, iov, 2);
+		if (len != (ssize_t)RECSIZE) {
+			err(1, "readv: record %d: read %d", i, (int)len);
+		}
+		if (strcmp(hbuf, header) || strcmp(pbuf, payload)) {
+			errx(1, "readv: record %d: wrong data", i);
+		}
+	}
+
+	/* pwrite/pread: must not move the offset */
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pwrite(fd, "XXXX", 4, 3 * RECSIZE) != 4) {
+		err(1, "pwrite");
+	}
+	memset(buf, 0, sizeof(buf));
+	if (pread(fd, buf, RECSIZE, 3 * RECSIZE) != (ssize_t)RECSIZE) {
+		err(1, "pread");
+	}
+	if (memcmp(buf, "XXXX", 4) || strcmp(buf + 4, payload)) {
+		errx(1, "pread: wrong data: %s", buf);
+	}
+	if (lseek(fd, 0, SEEK_CUR) != pos) {
+		errx(1, "pread/pwrite moved the file offset");
+	}
+
+	/* pwritev/preadv */
+	iov[0].iov_base = (void *)header;
+	iov[0].iov_len = sizeof(header) - 1;
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = sizeof(payload) - 1;
+	if (pwritev(fd, iov, 2, 3 * RECSIZE) != (ssize_t)RECSIZE) {
+		err(1, "pwritev");
+	}
+	memset(hbuf, 0, sizeof(hbuf));
+	memset(pbuf, 0, sizeof(pbuf));
+	iov[0].iov_base = hbuf;
+	iov[1].iov_base = pbuf;
+	if (preadv(fd, iov, 2, 3 * RECSIZE) != (ssize_t)RECSIZE) {
+		err(1, "preadv");
+	}
+	if (strcmp(hbuf, header) || strcmp(pbuf, payload)) {
+		errx(1, "preadv: wrong data");
+	}
+	if (lseek(fd, 0, SEEK_CUR) != pos) {
+		errx(1, "preadv/pwritev moved the file offset");
+	}
+
+	close(fd);
+	remove(FILENAME);
+	printf("iovtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * mmaptest.c
+ *
+ * 	Tests mmap and munmap.
+ *
+ * 	Checks that an anonymous mapping comes up zeroed and holds what
+ * 	is stored in it; that a private file mapping shows the file and
+ * 	keeps its stores to itself; that stores through a shared mapping
+ * 	reach the file after fsync and after munmap; that unmapping part
+ * 	of a mapping leaves the rest usable; and that bad arguments are
+ * 	refused.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <errno.h>
+
+#define TESTFILE "mmaptest.dat"
+#define PAGE     4096
+#define NPAGES   6
+/* Not a whole number of pages, so the last one is partly past EOF. */
+#define FILESIZE (NPAGES * PAGE - 1000)
+
+static
+unsigned char
+pattern(size_t i)
+{
+	return (unsigned char)(i * 7 + i / PAGE);
+}
+
+static
+void
+makefile(void)
+{
+	static unsigned char buf[FILESIZE];
+	size_t i;
+	int fd;
+
+	for (i = 0; i < FILESIZE; i++) {
+		buf[i] = pattern(i);
+	}
+	fd = open(TESTFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", TESTFILE);
+	}
+	if (write(fd, buf, FILESIZE) != FILESIZE) {
+		err(1, "%s: write", TESTFILE);
+	}
+	close(fd);
+}
+
+static
+void
+checkfile(size_t pos, unsigned char want, const char *when)
+{
+	unsigned char c;
+	int fd;
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	if (pread(fd, &c, 1, pos) != 1) {
+		err(1, "%s: pread", TESTFILE);
+	}
+	close(fd);
+	if (c != want) {
+		errx(1, "%s: byte %zu is %u, expected %u", when, pos,
+		     c, want);
+	}
+}
+
+static
+void
+testanon(void)
+{
+	unsigned char *p;
+	size_t i;
+
+	p = mmap(NULL, NPAGES * PAGE, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "anonymous mmap");
+	}
+	for (i = 0; i < NPAGES * PAGE; i++) {
+		if (p[i] != 0) {
+			errx(1, "anonymous mapping: byte %zu not zero", i);
+		}
+		p[i] = pattern(i);
+	}
+	for (i = 0; i < NPAGES * PAGE; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "anonymous mapping: byte %zu lost", i);
+		}
+	}
+	if (munmap(p, NPAGES * PAGE) < 0) {
+		err(1, "anonymous munmap");
+	}
+	printf("mmaptest: anonymous mapping ok\n");
+}
+
+static
+void
+testprivate(void)
+{
+	unsigned char *p;
+	size_t i;
+	int fd;
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	p = mmap(NULL, NPAGES * PAGE, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+		 fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "private mmap");
+	}
+	/* The mapping stays after the descriptor is closed. */
+	close(fd);
+
+	for (i = 0; i < NPAGES * PAGE; i++) {
+		if (p[i] != (i < FILESIZE ? pattern(i) : 0)) {
+			errx(1, "private mapping: byte %zu is %u", i, p[i]);
+		}
+	}
+	p[0] = ~pattern(0);
+	if (munmap(p, NPAGES * PAGE) < 0) {
+		err(1, "private munmap");
+	}
+	checkfile(0, pattern(0), "after private store");
+	printf("mmaptest: private file mapping ok\n");
+}
+
+static
+void
+testshared(void)
+{
+	unsigned char *p;
+	int fd;
+
+	fd = open(TESTFILE, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	p = mmap(NULL, NPAGES * PAGE, PROT_READ|PROT_WRITE, MAP_SHARED,
+		 fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "shared mmap");
+	}
+
+	p[10] = 0xaa;
+	if (fsync(fd) < 0) {
+		err(1, "fsync");
+	}
+	checkfile(10, 0xaa, "after fsync");
+
+	p[2 * PAGE + 3] = 0xbb;
+	p[FILESIZE - 1] = 0xcc;
+	if (munmap(p, NPAGES * PAGE) < 0) {
+		err(1, "shared munmap");
+	}
+	close(fd);
+	checkfile(2 * PAGE + 3, 0xbb, "after munmap");
+	checkfile(FILESIZE - 1, 0xcc, "after munmap");
+	printf("mmaptest: shared file mapping ok\n");
+}
+
+static
+void
+testpartial(void)
+{
+	unsigned char *p;
+	size_t i;
+
+	p = mmap(NULL, NPAGES * PAGE, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap for partial munmap");
+	}
+	for (i = 0; i < NPAGES * PAGE; i++) {
+		p[i] = pattern(i);
+	}
+
+	/* Punch out the middle two pages, then trim both ends. */
+	if (munmap(p + 2 * PAGE, 2 * PAGE) < 0) {
+		err(1, "munmap middle");
+	}
+	if (munmap(p, PAGE) < 0) {
+		err(1, "munmap head");
+	}
+	if (munmap(p + (NPAGES - 1) * PAGE, PAGE) < 0) {
+		err(1, "munmap tail");
+	}
+	for (i = PAGE; i < 2 * PAGE; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "partial munmap: byte %zu lost", i);
+		}
+	}
+	for (i = 4 * PAGE; i < 5 * PAGE; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "partial munmap: byte %zu lost", i);
+		}
+	}
+	if (munmap(p + PAGE, 2 * PAGE) == 0) {
+		errx(1, "munmap across a hole succeeded");
+	}
+	if (munmap(p + PAGE, PAGE) < 0 || munmap(p + 4 * PAGE, PAGE) < 0) {
+		err(1, "munmap remainder");
+	}
+	printf("mmaptest: partial munmap ok\n");
+}
+
+static
+void
+testbad(void)
+{
+	int fd;
+
+	if (mmap(NULL, 0, PROT_READ, MAP_PRIVATE|MAP_ANON, -1, 0)
+	    != MAP_FAILED || errno != EINVAL) {
+		errx(1, "zero-length mmap wasn't EINVAL");
+	}
+	if (mmap(NULL, PAGE, PROT_READ, MAP_PRIVATE, 1000, 0)
+	    != MAP_FAILED || errno != EBADF) {
+		errx(1, "mmap of a bad fd wasn't EBADF");
+	}
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	if (mmap(NULL, PAGE, PROT_READ, MAP_PRIVATE, fd, 100)
+	    != MAP_FAILED || errno != EINVAL) {
+		errx(1, "mmap at an unaligned offset wasn't EINVAL");
+	}
+	if (mmap(NULL, PAGE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)
+	    != MAP_FAILED || errno != EACCES) {
+		errx(1, "writeable shared mmap of a read-only fd "
+		     "wasn't EACCES");
+	}
+	close(fd);
+
+	if (munmap((void *)0x400000, PAGE) == 0) {
+		errx(1, "munmap of the program text succeeded");
+	}
+	printf("mmaptest: bad arguments refused\n");
+}
+
+int
+main(void)
+{
+	makefile();
+	testanon();
+	testprivate();
+	testshared();
+	testpartial();
+	testbad();
+	remove(TESTFILE);
+	printf("mmaptest: passed\n");
+	return 0;
+}
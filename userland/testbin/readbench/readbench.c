@@ -0,0 +1,129 @@
+/*
+ * readbench.c
+ *
+ * 	Measures read() throughput into a user buffer.
+ *
+ * 	Writes a FILESIZE file, then reads all of it back with each of a
+ * 	range of buffer sizes, checking the contents and reporting the
+ * 	rate. This is the user-space counterpart of the kernel's fs
+ * 	read benchmark, which calls VOP_READ directly and so doesn't go
+ * 	through sys_read's user buffer path.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define TESTFILE "readbench.dat"
+#define FILESIZE (512*1024)
+#define CHUNK    4096		/* size the file is written in */
+
+static const size_t sizes[] = {
+	512, 4096, 32768, 131072, 524288,
+};
+
+static char buf[FILESIZE];
+
+static
+char
+pattern(size_t i)
+{
+	return (char)('a' + i % 23 + i / CHUNK % 3);
+}
+
+static
+void
+makefile(void)
+{
+	size_t i;
+	int fd;
+
+	for (i = 0; i < FILESIZE; i++) {
+		buf[i] = pattern(i);
+	}
+	fd = open(TESTFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", TESTFILE);
+	}
+	for (i = 0; i < FILESIZE; i += CHUNK) {
+		if (write(fd, buf + i, CHUNK) != CHUNK) {
+			err(1, "%s: write", TESTFILE);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+readfile(size_t bufsize)
+{
+	time_t secs0, secs1;
+	unsigned long nsecs0, nsecs1;
+	unsigned long long nsecs;
+	size_t pos, i;
+	ssize_t len;
+	int fd;
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+	memset(buf, 0, sizeof(buf));
+
+	__time(&secs0, &nsecs0);
+	pos = 0;
+	while (pos < FILESIZE) {
+		/* Each read lands where it belongs in buf. */
+		len = read(fd, buf + pos, bufsize);
+		if (len < 0) {
+			err(1, "%s: read", TESTFILE);
+		}
+		if (len == 0) {
+			break;
+		}
+		pos += len;
+	}
+	__time(&secs1, &nsecs1);
+	close(fd);
+
+	if (pos != FILESIZE) {
+		errx(1, "%s: %lu bytes read, should have been %lu",
+		     TESTFILE, (unsigned long)pos, (unsigned long)FILESIZE);
+	}
+	for (i = 0; i < FILESIZE; i++) {
+		if (buf[i] != pattern(i)) {
+			errx(1, "%s: wrong data at offset %lu with "
+			     "%lu-byte reads", TESTFILE, (unsigned long)i,
+			     (unsigned long)bufsize);
+		}
+	}
+
+	nsecs = (secs1 - secs0) * 1000000000ULL + nsecs1 - nsecs0;
+	if (nsecs == 0) {
+		nsecs = 1;
+	}
+	printf("%7lu-byte reads: %llu.%09llu s, %llu KB/s\n",
+	       (unsigned long)bufsize, nsecs / 1000000000ULL,
+	       nsecs % 1000000000ULL,
+	       FILESIZE * 1000000000ULL / nsecs / 1024);
+}
+
+int
+main(void)
+{
+	unsigned i;
+
+	printf("readbench: starting\n");
+	makefile();
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		readfile(sizes[i]);
+	}
+	if (remove(TESTFILE)) {
+		err(1, "%s: remove", TESTFILE);
+	}
+	printf("readbench: done\n");
+	return 0;
+}
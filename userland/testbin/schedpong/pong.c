@@ -33,6 +33,7 @@
  */
 
 #include <stdio.h>
+#include <unistd.h>
 #include <err.h>
 #include <assert.h>
 
@@ -82,23 +83,57 @@ pong_cleanup(unsigned groupid, unsigned count)
 	}
 }
 
+/*
+ * Microseconds from (SECS0, NSECS0) to now.
+ */
+static
+unsigned
+usecs_since(time_t secs0, unsigned long nsecs0)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - secs0) * 1000000 + nsecs / 1000 - nsecs0 / 1000;
+}
+
 /*
  * Pong in order. Wait on our semaphore, then wake the next one.
  * If we're id 0, don't wait the first go so things start, but do
  * wait the last go.
+ *
+ * Id 0 also times each lap around the ring, which is how long it
+ * takes to wake up every ponger in turn: this is the group's wakeup
+ * latency, and what the scheduler should keep low when there are
+ * CPU-bound tasks running too.
  */
 static
 void
-pong_cyclic(unsigned id)
+pong_cyclic(unsigned groupid, unsigned id)
 {
 	unsigned i;
 	unsigned nextid;
+	time_t lapsecs = 0;
+	unsigned long lapnsecs = 0;
+	unsigned lap, laps = 0, lapmax = 0;
+	unsigned long laptotal = 0;
 
 	nextid = (id + 1) % nsems;
 	for (i=0; i<PONGLOOPS; i++) {
 		if (i > 0 || id > 0) {
 			P(&sems[id]);
 		}
+		if (id == 0) {
+			if (i > 0) {
+				lap = usecs_since(lapsecs, lapnsecs);
+				laptotal += lap;
+				laps++;
+				if (lap > lapmax) {
+					lapmax = lap;
+				}
+			}
+			__time(&lapsecs, &lapnsecs);
+		}
 #ifdef VERBOSE_PONG
 		tprintf(" %u", id);
 #else
@@ -110,6 +145,12 @@ pong_cyclic(unsigned id)
 	}
 	if (id == 0) {
 		P(&sems[id]);
+		lap = usecs_since(lapsecs, lapnsecs);
+		laptotal += lap;
+		laps++;
+		if (lap > lapmax) {
+			lapmax = lap;
+		}
 	}
 #ifdef VERBOSE_PONG
 	putchar('\n');
@@ -118,6 +159,10 @@ pong_cyclic(unsigned id)
 		putchar('\n');
 	}
 #endif
+	if (id == 0) {
+		tprintf("Pong group %u: lap latency avg %lu us, max %u us\n",
+			groupid - 2, laptotal / laps, lapmax);
+	}
 }
 
 /*
@@ -186,8 +231,6 @@ pong(unsigned groupid, unsigned id)
 {
 	unsigned idfwd, idback;
 
-	(void)groupid;
-
 	idfwd = (id + 1) % nsems;
 	idback = (id + nsems - 1) % nsems;
 	usem_open(&sems[id]);
@@ -195,7 +238,7 @@ pong(unsigned groupid, unsigned id)
 	usem_open(&sems[idback]);
 
 	waitstart();
-	pong_cyclic(id);
+	pong_cyclic(groupid, id);
 #ifdef VERBOSE_PONG
 	tprintf("--------------------------------\n");
 #endif
@@ -203,7 +246,7 @@ pong(unsigned groupid, unsigned id)
 #ifdef VERBOSE_PONG
 	tprintf("--------------------------------\n");
 #endif
-	pong_cyclic(id);
+	pong_cyclic(groupid, id);
 
 	usem_close(&sems[id]);
 	usem_close(&sems[idfwd]);
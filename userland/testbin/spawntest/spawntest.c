@@ -0,0 +1,97 @@
+/*
+ * spawntest.c
+ *
+ * 	Tests spawn.
+ *
+ * 	Spawns /bin/cat on a file we wrote, with its stdout redirected
+ * 	to another file by a dup2 file action, waits for it, and checks
+ * 	that what it wrote is the same. (cat is used because its output
+ * 	is exactly its input; the test161 programs print extra lines
+ * 	depending on how they were built.) Also
+ * 	checks that spawning a missing program fails in the parent and
+ * 	that the parent's own descriptors are left alone.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <errno.h>
+
+#define INFILE   "spawntest.in"
+#define FILENAME "spawntest.out"
+#define PROG     "/bin/cat"
+#define EXPECT   "spawntest: the child's output\n"
+
+int
+main(void)
+{
+	struct spawn_action actions[2];
+	char *args[3];
+	char buf[64];
+	ssize_t len;
+	pid_t pid;
+	int fd, status;
+
+	fd = open(INFILE, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", INFILE);
+	}
+	len = write(fd, EXPECT, strlen(EXPECT));
+	if (len != (ssize_t)strlen(EXPECT)) {
+		err(1, "%s: write", INFILE);
+	}
+	close(fd);
+
+	fd = open(FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+
+	args[0] = (char *)PROG;
+	args[1] = (char *)INFILE;
+	args[2] = NULL;
+
+	actions[0].sa_op = SPAWN_DUP2;
+	actions[0].sa_fd = fd;
+	actions[0].sa_newfd = STDOUT_FILENO;
+	actions[1].sa_op = SPAWN_CLOSE;
+	actions[1].sa_fd = fd;
+	actions[1].sa_newfd = -1;
+
+	pid = spawn(PROG, args, actions, 2);
+	if (pid < 0) {
+		err(1, "spawn %s", PROG);
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s exited with status 0x%x", PROG, status);
+	}
+
+	/* The child shared our handle, offset and all; rewind it. */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek: fd not open in parent after spawn");
+	}
+	memset(buf, 0, sizeof(buf));
+	len = read(fd, buf, sizeof(buf) - 1);
+	if (len < 0) {
+		err(1, "read");
+	}
+	if (strcmp(buf, EXPECT)) {
+		errx(1, "child wrote \"%s\", expected \"%s\"", buf, EXPECT);
+	}
+	close(fd);
+	remove(FILENAME);
+	remove(INFILE);
+
+	pid = spawn("/testbin/no-such-program", args, NULL, 0);
+	if (pid >= 0 || errno != ENOENT) {
+		errx(1, "spawn of missing program: pid %d, errno %d",
+		     pid, errno);
+	}
+
+	printf("spawntest: passed\n");
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * waitany.c
+ *
+ * 	Tests waitpid with pid -1 and WNOHANG.
+ *
+ * 	Forks a batch of children that each exit with their own status,
+ * 	reaps them all with waitpid(-1), and checks every child turns up
+ * 	exactly once with the right status. Then checks that WNOHANG
+ * 	returns 0 for a child that hasn't exited yet, and that waiting
+ * 	with no children left fails with ECHILD.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <errno.h>
+
+#define NKIDS    24
+#define GOFILE   "waitany.go"
+
+static pid_t kids[NKIDS];
+
+int
+main(void)
+{
+	pid_t pid;
+	int i, j, status, fd, seen[NKIDS];
+
+	for (i = 0; i < NKIDS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(i);
+		}
+		kids[i] = pid;
+		seen[i] = 0;
+	}
+
+	for (i = 0; i < NKIDS; i++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			err(1, "waitpid(-1) #%d", i);
+		}
+		for (j = 0; j < NKIDS && kids[j] != pid; j++) {
+			;
+		}
+		if (j == NKIDS) {
+			errx(1, "waitpid(-1) returned stranger %d", pid);
+		}
+		if (seen[j]) {
+			errx(1, "child %d reaped twice", pid);
+		}
+		seen[j] = 1;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != j) {
+			errx(1, "child %d: status 0x%x, expected exit %d",
+			     pid, status, j);
+		}
+	}
+
+	if (waitpid(-1, &status, 0) >= 0 || errno != ECHILD) {
+		errx(1, "waitpid(-1) with no children didn't fail with ECHILD");
+	}
+
+	/* A child that can't exit until we say so. */
+	remove(GOFILE);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		while ((fd = open(GOFILE, O_RDONLY)) < 0) {
+			;
+		}
+		close(fd);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, WNOHANG) != 0) {
+		errx(1, "WNOHANG on a running child didn't return 0");
+	}
+	if (waitpid(-1, &status, WNOHANG) != 0) {
+		errx(1, "WNOHANG with pid -1 didn't return 0");
+	}
+
+	fd = open(GOFILE, O_WRONLY | O_CREAT, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", GOFILE);
+	}
+	close(fd);
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	remove(GOFILE);
+
+	printf("waitany: passed\n");
+	return 0;
+}